@@ -0,0 +1,184 @@
+#include "openbw/replay.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <vector>
+
+#ifdef __GLIBC__
+#include <execinfo.h>
+#endif
+
+#ifndef BWGAME_COUNT_ALLOCATIONS
+#error allocation_test must be built with BWGAME_COUNT_ALLOCATIONS
+#endif
+
+using namespace bwgame;
+
+namespace {
+
+struct call_site {
+	size_t allocations = 0;
+	size_t bytes = 0;
+	size_t frames = 0;
+	int first_frame = -1;
+	int last_frame = -1;
+};
+
+// Keyed by backtrace. These are std containers rather than a_* ones, so that recording
+// an allocation is not counted as one.
+std::map<std::vector<void*>, call_site> call_sites;
+int measured_frame = 0;
+
+void record_allocation(size_t bytes) {
+	std::vector<void*> trace;
+#ifdef __GLIBC__
+	trace.resize(24);
+	trace.resize(backtrace(trace.data(), (int)trace.size()));
+#endif
+	auto& v = call_sites[std::move(trace)];
+	++v.allocations;
+	v.bytes += bytes;
+	if (v.last_frame != measured_frame) {
+		++v.frames;
+		if (v.first_frame == -1) v.first_frame = measured_frame;
+		v.last_frame = measured_frame;
+	}
+}
+
+void print_call_sites() {
+	std::vector<std::pair<const std::vector<void*>*, const call_site*>> sorted;
+	for (auto& v : call_sites) sorted.emplace_back(&v.first, &v.second);
+	std::sort(sorted.begin(), sorted.end(), [](auto& a, auto& b) {
+		return a.second->allocations > b.second->allocations;
+	});
+	for (auto& v : sorted) {
+		auto& site = *v.second;
+		printf("  %d allocations (%d bytes) in %d frames, first in frame %d:\n", (int)site.allocations, (int)site.bytes, (int)site.frames, site.first_frame);
+#ifdef __GLIBC__
+		auto& trace = *v.first;
+		// The first two entries are record_allocation and counting_allocator::allocate.
+		char** symbols = backtrace_symbols(trace.data(), (int)trace.size());
+		for (size_t i = 2; i < trace.size(); ++i) {
+			printf("    %s\n", symbols ? symbols[i] : "?");
+		}
+		free(symbols);
+#else
+		printf("    (call sites are only recorded with glibc)\n");
+#endif
+	}
+}
+
+// Returns the number of allocations made by next_frame after the warm-up.
+size_t test_replay(const char* data_path, const char* filename, int warmup_frames) {
+	replay_player player;
+	player.init(data_path);
+	player.load_replay_file(filename);
+
+	while (!player.is_done() && player.st().current_frame < warmup_frames) {
+		player.next_frame();
+	}
+
+	auto& counters = allocation_counters::current();
+	call_sites.clear();
+	counters.on_allocate = record_allocation;
+	size_t frames = 0;
+	size_t allocating_frames = 0;
+	size_t allocations = 0;
+	size_t bytes = 0;
+	size_t max_frame_allocations = 0;
+	int max_frame = -1;
+	while (!player.is_done()) {
+		measured_frame = player.st().current_frame;
+		size_t prev_allocations = counters.allocations;
+		size_t prev_bytes = counters.allocated_bytes;
+		player.next_frame();
+		size_t n = counters.allocations - prev_allocations;
+		++frames;
+		allocations += n;
+		bytes += counters.allocated_bytes - prev_bytes;
+		if (n) ++allocating_frames;
+		if (n > max_frame_allocations) {
+			max_frame_allocations = n;
+			max_frame = measured_frame;
+		}
+	}
+	counters.on_allocate = nullptr;
+
+	printf("%s: %d frames after %d warm-up frames, %d allocations (%d bytes) in %d frames", filename, (int)frames, warmup_frames, (int)allocations, (int)bytes, (int)allocating_frames);
+	if (max_frame != -1) printf(", at most %d in frame %d", (int)max_frame_allocations, max_frame);
+	printf("\n");
+	print_call_sites();
+
+	return allocations;
+}
+
+// The path buffers are reserved once and then reused through assignment, which must
+// neither allocate nor lose elements, including when a buffer is assigned to itself.
+bool check_path_buffers() {
+	auto& counters = allocation_counters::current();
+	a_circular_vector<xy> a;
+	a_circular_vector<xy> b;
+	a.reserve(128);
+	b.reserve(128);
+	size_t prev_allocations = counters.allocations;
+	for (int i = 0; i != 100; ++i) a.push_front(xy(i, i));
+	b = a;
+	a = {xy(1, 1), xy(2, 2)};
+	b = b;
+	a = std::move(b);
+	a.resize(50);
+	b.resize(1);
+	b = a;
+	bool ok = true;
+	if (counters.allocations != prev_allocations) {
+		printf("path buffers: %d allocations after reserve\n", (int)(counters.allocations - prev_allocations));
+		ok = false;
+	}
+	if (a.size() != 50 || b.size() != 50 || a[49] != xy(50, 50) || b[0] != xy(99, 99)) {
+		printf("path buffers: wrong contents after assignment\n");
+		ok = false;
+	}
+	return ok;
+}
+
+}
+
+int main(int argc, char const* argv[])
+{
+	const char* data_path = "";
+	int warmup_frames = 1000;
+	size_t max_allocations = 0;
+
+	int i = 1;
+	for (; i + 1 < argc && argv[i][0] == '-'; i += 2) {
+		a_string opt = argv[i];
+		if (opt == "-d") data_path = argv[i + 1];
+		else if (opt == "-w") warmup_frames = std::atoi(argv[i + 1]);
+		else if (opt == "-m") max_allocations = (size_t)std::atoll(argv[i + 1]);
+		else break;
+	}
+	if (i == argc || argv[i][0] == '-') {
+		fprintf(stderr, "usage: %s [-d data directory] [-w warm-up frames] [-m max allocations] <replay files...>\n", argv[0]);
+		return 1;
+	}
+
+	if (!check_path_buffers()) return 1;
+
+	size_t over_budget = 0;
+	size_t failed = 0;
+	for (; i != argc; ++i) {
+		try {
+			if (test_replay(data_path, argv[i], warmup_frames) > max_allocations) ++over_budget;
+		} catch (const std::exception& e) {
+			fprintf(stderr, "%s: %s\n", argv[i], e.what());
+			++failed;
+		}
+	}
+
+	if (over_budget) printf("%d replays made more than %d allocations after the warm-up\n", (int)over_budget, (int)max_allocations);
+
+	if (failed) return 2;
+	return over_budget ? 1 : 0;
+}
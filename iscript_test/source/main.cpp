@@ -0,0 +1,143 @@
+#include "openbw/replay.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace bwgame;
+
+namespace {
+
+// Like the insync hash in sync.h, but it also covers every image, so that a difference
+// in iscript shows up in the frame it happens rather than once it reaches a unit.
+uint32_t state_hash(const state& st) {
+	uint32_t hash = 2166136261u;
+	auto add = [&](auto v) {
+		hash ^= (uint32_t)v;
+		hash *= 16777619u;
+	};
+	add(st.lcg_rand_state);
+	add(st.total_random_counts);
+	for (auto v : st.current_minerals) add(v);
+	for (auto v : st.current_gas) add(v);
+	add(st.active_orders_size);
+	add(st.active_bullets_size);
+	add(st.active_thingies_size);
+	for (const unit_t* u : ptr(st.visible_units)) {
+		add((u->shield_points + u->hp).raw_value);
+		add(u->exact_position.x.raw_value);
+		add(u->exact_position.y.raw_value);
+		add(u->order_signal);
+	}
+	for (auto& line : st.sprites_on_tile_line) {
+		for (const sprite_t* sprite : ptr(line)) {
+			add(sprite->position.x);
+			add(sprite->position.y);
+			add(sprite->flags);
+			for (const image_t* image : ptr(sprite->images)) {
+				add(image->frame_index);
+				add(image->offset.x);
+				add(image->offset.y);
+				add(image->flags);
+				add(image->modifier_data1);
+				add(image->modifier_data2);
+				add(image->iscript_state.program_counter);
+				add(image->iscript_state.return_address);
+				add(image->iscript_state.wait);
+			}
+		}
+	}
+	return hash;
+}
+
+struct run_result {
+	a_vector<uint32_t> hashes;
+	double seconds = 0;
+};
+
+// Only next_frame is timed, not the hashing.
+run_result play(const char* data_path, const char* filename, bool switch_dispatch) {
+	replay_player player;
+	player.init(data_path);
+	player.lazy_init();
+	player.opt_funcs->iscript_switch_dispatch = switch_dispatch;
+	player.load_replay_file(filename);
+
+	run_result r;
+	std::chrono::steady_clock::duration time{};
+	while (!player.is_done()) {
+		auto start = std::chrono::steady_clock::now();
+		player.next_frame();
+		time += std::chrono::steady_clock::now() - start;
+		r.hashes.push_back(state_hash(player.st()));
+	}
+	r.seconds = std::chrono::duration<double>(time).count();
+	return r;
+}
+
+// Returns whether both dispatchers gave the same state in every frame.
+bool test_replay(const char* data_path, const char* filename, int runs) {
+	run_result switch_run;
+	run_result goto_run;
+	double switch_seconds = 0;
+	double goto_seconds = 0;
+	// The runs alternate and the fastest of each is kept, to even out the noise.
+	for (int i = 0; i != runs; ++i) {
+		switch_run = play(data_path, filename, true);
+		goto_run = play(data_path, filename, false);
+		if (i == 0 || switch_run.seconds < switch_seconds) switch_seconds = switch_run.seconds;
+		if (i == 0 || goto_run.seconds < goto_seconds) goto_seconds = goto_run.seconds;
+		if (goto_run.hashes != switch_run.hashes) break;
+	}
+
+	auto& a = switch_run.hashes;
+	auto& b = goto_run.hashes;
+	if (a != b) {
+		size_t frame = 0;
+		while (frame != a.size() && frame != b.size() && a[frame] == b[frame]) ++frame;
+		printf("%s: the state differs from frame %d (%d frames with switch, %d with computed goto)\n", filename, (int)frame, (int)a.size(), (int)b.size());
+		return false;
+	}
+	printf("%s: %d frames, state matches; switch %.3fs, computed goto %.3fs (%+.1f%%)\n", filename, (int)a.size(), switch_seconds, goto_seconds, (goto_seconds / switch_seconds - 1.0) * 100.0);
+	return true;
+}
+
+}
+
+int main(int argc, char const* argv[])
+{
+	const char* data_path = "";
+	int runs = 3;
+
+	int i = 1;
+	for (; i + 1 < argc && argv[i][0] == '-'; i += 2) {
+		a_string opt = argv[i];
+		if (opt == "-d") data_path = argv[i + 1];
+		else if (opt == "-r") runs = std::atoi(argv[i + 1]);
+		else break;
+	}
+	if (i == argc || argv[i][0] == '-' || runs < 1) {
+		fprintf(stderr, "usage: %s [-d data directory] [-r runs] <replay files...>\n", argv[0]);
+		return 1;
+	}
+
+#ifndef BWGAME_ISCRIPT_COMPUTED_GOTO
+	printf("computed goto is not available with this compiler; both runs use the switch\n");
+#endif
+
+	size_t differing = 0;
+	size_t failed = 0;
+	for (; i != argc; ++i) {
+		try {
+			if (!test_replay(data_path, argv[i], runs)) ++differing;
+		} catch (const std::exception& e) {
+			fprintf(stderr, "%s: %s\n", argv[i], e.what());
+			++failed;
+		}
+	}
+
+	if (differing) printf("%d replays played differently with the two dispatchers\n", (int)differing);
+
+	if (failed) return 2;
+	return differing ? 1 : 0;
+}
@@ -45,10 +45,10 @@ namespace bwgame::action_data
 	using upgrade_level_t = uint8_t;
 	using resource_amount_t = int32_t;
 
-	inline id_t get_primary_id(id_t id) { return id; }
+	constexpr id_t get_primary_id(id_t id) { return id; }
 
 	template <size_t N, typename O>
-	id_t get_primary_id(const geom::vector<id_t,N,O>& id) { return id[0]; }
+	constexpr id_t get_primary_id(const geom::vector<id_t,N,O>& id) { return id[0]; }
 
 	template <typename T>
 	struct tuple_capacity;
@@ -95,6 +95,136 @@ namespace bwgame::action_data
 			put(w, unit);
 	}
 
+	// Converts a parameter from its data form to the form passed to the action functions.
+	// Anything referring to units is resolved against st, so this has to be done in the state
+	// the action is executed in.
+	template <typename T>
+	void from_data_param(state&, const T& raw, T& param) { param = raw; }
+
+	inline void from_data_param(state& st, unit_id_t raw, unit_t*& unit)
+	{
+		unit = get_unit(st, unit_id(raw));
+	}
+
+	inline void from_data_param(state& st, unit_type_id_t raw, const unit_type_t*& type)
+	{
+		type = get_unit_type(st, UnitTypes(raw));
+	}
+
+	inline void from_data_param(state& st, tech_type_id_t raw, const tech_type_t*& type)
+	{
+		type = get_tech_type(st, TechTypes(raw));
+	}
+
+	inline void from_data_param(state& st, upgrade_type_id_t raw, const upgrade_type_t*& type)
+	{
+		type = get_upgrade_type(st, UpgradeTypes(raw));
+	}
+
+	inline void from_data_param(state& st, order_id_t raw, const order_type_t*& order)
+	{
+		order = get_order_type(st, Orders(raw));
+	}
+
+	inline void from_data_param(state&, alliance_flags_t flags, alliance_array& alliances)
+	{
+		// thanks std for not providing compile time array size -_-
+		assert(std::numeric_limits<alliance_flags_t>::digits/2 >= alliances.size());
+		static_assert(std::is_unsigned_v<alliance_flags_t>);
+		for (size_t i = 0; i != alliances.size(); ++i) {
+			alliances[i] = flags & 0b11;
+			flags >>= 2;
+		}
+	}
+
+	inline void from_data_param(state&, bool_t raw, bool& value)
+	{
+		value = raw != 0;
+	}
+
+	inline void from_data_param(state&, const chat_message_t& raw, std::string& message)
+	{
+		for (auto& c : raw) {
+			if (c == 0) break;
+			if (c >= 32) message += (char)c;
+		}
+	}
+
+	inline void from_data_param(state& st, const selection_id_array& raw, selection_array& selection)
+	{
+		selection = selection_array({}, {selection_array::size_type(raw.end() - raw.begin())});
+		auto unit = selection.begin();
+		for (auto id : raw)
+			from_data_param(st, id, *unit++);
+	}
+
+	// Unit selections and chat messages are stored out of line in an action_payloads,
+	// so that a parameter in compact form is small and of fixed size.
+	struct selection_ref
+	{
+		uint32_t offset;
+		uint8_t size;
+	};
+
+	struct chat_message_ref
+	{
+		uint32_t index;
+	};
+
+	struct action_payloads
+	{
+		a_vector<unit_id_t> units;
+		a_vector<chat_message_t> chat_messages;
+	};
+
+	template <typename T>
+	struct compact_param { using type = T; };
+
+	template <>
+	struct compact_param<selection_id_array> { using type = selection_ref; };
+
+	template <>
+	struct compact_param<chat_message_t> { using type = chat_message_ref; };
+
+	template <typename T>
+	using compact_param_t = typename compact_param<T>::type;
+
+	template <typename T>
+	T to_compact_param(action_payloads&, const T& raw) { return raw; }
+
+	inline selection_ref to_compact_param(action_payloads& payloads, const selection_id_array& raw)
+	{
+		selection_ref r{(uint32_t)payloads.units.size(), (uint8_t)(raw.end() - raw.begin())};
+		payloads.units.insert(payloads.units.end(), raw.begin(), raw.end());
+		return r;
+	}
+
+	inline chat_message_ref to_compact_param(action_payloads& payloads, const chat_message_t& raw)
+	{
+		chat_message_ref r{(uint32_t)payloads.chat_messages.size()};
+		payloads.chat_messages.push_back(raw);
+		return r;
+	}
+
+	template <typename T, typename F>
+	void from_compact_param(state& st, const action_payloads&, const T& compact, F& param)
+	{
+		from_data_param(st, compact, param);
+	}
+
+	inline void from_compact_param(state& st, const action_payloads& payloads, selection_ref compact, selection_array& selection)
+	{
+		selection = selection_array({}, {selection_array::size_type(compact.size)});
+		auto unit = selection.begin();
+		for (size_t i = 0; i != compact.size; ++i)
+			from_data_param(st, payloads.units[compact.offset + i], *unit++);
+	}
+
+	inline void from_compact_param(state& st, const action_payloads& payloads, chat_message_ref compact, std::string& message)
+	{
+		from_data_param(st, payloads.chat_messages[compact.index], message);
+	}
+
 	template <typename Reader, typename T>
 	bool get(Reader&& r, state&, T& value)
 	{
@@ -108,7 +238,7 @@ namespace bwgame::action_data
 	{
 		unit_id_t id;
 		if(not get(r,st,id)) return false;
-		unit = get_unit(st, unit_id(id));
+		from_data_param(st, id, unit);
 		return true;
 	}
 
@@ -117,7 +247,7 @@ namespace bwgame::action_data
 	{
 		unit_type_id_t id;
 		if(not get(r,st,id)) return false;
-		type = get_unit_type(st, UnitTypes(id));
+		from_data_param(st, id, type);
 		return true;
 	}
 
@@ -126,7 +256,7 @@ namespace bwgame::action_data
 	{
 		tech_type_id_t id;
 		if(not get(r,st,id)) return false;
-		type = get_tech_type(st, TechTypes(id));
+		from_data_param(st, id, type);
 		return true;
 	}
 
@@ -135,7 +265,7 @@ namespace bwgame::action_data
 	{
 		upgrade_type_id_t id;
 		if(not get(r,st,id)) return false;
-		type = get_upgrade_type(st, UpgradeTypes(id));
+		from_data_param(st, id, type);
 		return true;
 	}
 
@@ -144,7 +274,7 @@ namespace bwgame::action_data
 	{
 		order_id_t id;
 		if(not get(r,st,id)) return false;
-		order = get_order_type(st, Orders(id));
+		from_data_param(st, id, order);
 		return true;
 	}
 
@@ -153,14 +283,7 @@ namespace bwgame::action_data
 	{
 		alliance_flags_t flags;
 		if(not get(r,st,flags)) return false;
-
-		// thanks std for not providing compile time array size -_-
-		assert(std::numeric_limits<alliance_flags_t>::digits/2 >= alliances.size());
-		static_assert(std::is_unsigned_v<alliance_flags_t>);
-		for (size_t i = 0; i != alliances.size(); ++i) {
-			alliances[i] = flags & 0b11;
-			flags >>= 2;
-		}
+		from_data_param(st, flags, alliances);
 		return true;
 	}
 
@@ -178,7 +301,7 @@ namespace bwgame::action_data
 	{
 		bool_t raw_value;
 		if(not get(r,st,raw_value)) return false;
-		value = raw_value != 0;
+		from_data_param(st, raw_value, value);
 		return true;
 	}
 
@@ -187,20 +310,17 @@ namespace bwgame::action_data
 	{
 		chat_message_t raw_message;
 		if(not get(r,st,raw_message)) return false;
-		for (auto& c : raw_message) {
-			if (c == 0) break;
-			if (c >= 32) message += (char)c;
-		}
+		from_data_param(st, raw_message, message);
 		return true;
 	}
 
 	template <typename Reader>
-	bool get(Reader&& r, state& st, selection_array& selection)
+	bool get(Reader&& r, state& st, selection_id_array& selection)
 	{
 		selection_id_array::size_type raw_size;
 
 		if(not get(r,st,raw_size)) return false;
-		selection = selection_array({}, {raw_size});
+		selection = selection_id_array({}, {raw_size});
 		for (auto& unit : selection)
 		{
 			if(not get(r, st, unit)) return false;
@@ -208,6 +328,15 @@ namespace bwgame::action_data
 		return true;
 	}
 
+	template <typename Reader>
+	bool get(Reader&& r, state& st, selection_array& selection)
+	{
+		selection_id_array raw_selection;
+		if(not get(r,st,raw_selection)) return false;
+		from_data_param(st, raw_selection, selection);
+		return true;
+	}
+
 	struct
 	{
 
@@ -342,14 +471,15 @@ namespace bwgame::action_data
 			return w;
 		};
 
+		// Reads the parameters in their data form, without resolving anything against st.
 		template <typename Reader>
-		static std::optional<func_params> read(Reader&& r, state& st)
+		static std::optional<params> read_data(Reader&& r, state& st)
 		{
 			auto id = Action::id;
 			if(not get(r, st, id)) return std::nullopt;
 			if(id != Action::id) return std::nullopt;
 
-			func_params result;
+			params result;
 			auto failed_count = action_data::read(r,st,result);
 			if(failed_count == 0)
 			{
@@ -358,12 +488,58 @@ namespace bwgame::action_data
 			else
 			{
 #ifndef NDEBUG
-				std::cerr << "parsing action data failed at parameter " << std::tuple_size_v<func_params> - failed_count << '\n';
+				std::cerr << "parsing action data failed at parameter " << std::tuple_size_v<params> - failed_count << '\n';
 #endif
 				return std::nullopt;
 			}
 		}
 
+		static func_params to_func_params(state& st, const params& p)
+		{
+			return to_func_params(st, p, std::make_index_sequence<std::tuple_size_v<params>>{});
+		}
+
+		template <typename Reader>
+		static std::optional<func_params> read(Reader&& r, state& st)
+		{
+			auto result = read_data(r, st);
+			if(not result) return std::nullopt;
+			return std::optional(to_func_params(st, *result));
+		}
+
+		template <size_t... I>
+		static func_params to_func_params(state& st, const params& p, std::index_sequence<I...>)
+		{
+			func_params result;
+			(from_data_param(st, std::get<I>(p), std::get<I>(result)), ...);
+			return result;
+		}
+
+		using compact_params = sup::transform_t<params, compact_param_t>;
+
+		// Converts the parameters to their compact form, storing selections and chat
+		// messages in payloads.
+		static compact_params to_compact(action_payloads& payloads, const params& p)
+		{
+			return std::apply([&](auto&... v)
+			{
+				return compact_params{to_compact_param(payloads, v)...};
+			}, p);
+		}
+
+		static func_params to_func_params(state& st, const action_payloads& payloads, const compact_params& p)
+		{
+			return to_func_params(st, payloads, p, std::make_index_sequence<std::tuple_size_v<compact_params>>{});
+		}
+
+		template <size_t... I>
+		static func_params to_func_params(state& st, const action_payloads& payloads, const compact_params& p, std::index_sequence<I...>)
+		{
+			func_params result;
+			(from_compact_param(st, payloads, std::get<I>(p), std::get<I>(result)), ...);
+			return result;
+		}
+
 	};
 
 	template <id_t ID>
@@ -749,6 +925,62 @@ namespace bwgame::action_data
 		ext_cheat_minerals, ext_cheat_gas
 	>;
 
+	constexpr size_t all_types_count = std::tuple_size_v<all_types>;
+
+	template <size_t... I>
+	constexpr std::array<id_t, all_types_count> make_primary_ids(std::index_sequence<I...>)
+	{
+		return {get_primary_id(std::tuple_element_t<I, all_types>::id)...};
+	}
+
+	constexpr auto primary_ids = make_primary_ids(std::make_index_sequence<all_types_count>{});
+
+	// For every possible first byte of an action, the index of the first type in all_types
+	// with that primary id, or -1.
+	constexpr auto make_first_type_index()
+	{
+		std::array<int, 256> r{};
+		for (auto& v : r) v = -1;
+		for (size_t i = all_types_count; i--;) r[primary_ids[i]] = (int)i;
+		return r;
+	}
+
+	constexpr auto first_type_index = make_first_type_index();
+
+	constexpr bool primary_ids_are_grouped()
+	{
+		for (size_t i = 0; i != all_types_count; ++i)
+		{
+			if (first_type_index[primary_ids[i]] == (int)i) continue;
+			if (primary_ids[i - 1] != primary_ids[i]) return false;
+		}
+		return true;
+	}
+
+	static_assert(primary_ids_are_grouped(), "types sharing a primary id must be adjacent in all_types");
+
+	template <typename F, size_t... I>
+	bool visit_type(size_t index, F& f, std::index_sequence<I...>)
+	{
+		using handler_t = bool(*)(F&);
+		static constexpr handler_t handlers[] = { [](F& f) -> bool { return f(std::tuple_element_t<I, all_types>{}); }... };
+		return handlers[index](f);
+	}
+
+	// Calls f with an instance of each type in all_types whose primary id is id, in order,
+	// until it returns true. The first type is found with a single table lookup.
+	template <typename F>
+	bool dispatch(id_t id, F&& f)
+	{
+		int index = first_type_index[id];
+		if (index == -1) return false;
+		for (size_t i = index; i != all_types_count && primary_ids[i] == id; ++i)
+		{
+			if (visit_type(i, f, std::make_index_sequence<all_types_count>{})) return true;
+		}
+		return false;
+	}
+
 	template <typename T>
 	using make_alternative_t = sup::prepend_t<typename T::func_params, T>;
 
@@ -762,6 +994,12 @@ namespace bwgame::action_data
 
 	using variant = tuple_to_variant_t<sup::transform_t<all_types, make_alternative_t>>;
 
+	template <typename T>
+	using make_compact_alternative_t = std::tuple<T, typename T::compact_params>;
+
+	// An action with its parameters in compact form, see action_interface::to_compact.
+	using compact_variant = tuple_to_variant_t<sup::transform_t<all_types, make_compact_alternative_t>>;
+
 } // namespace bwgame
 
 #endif /* end of include guard */
@@ -19,7 +19,29 @@ struct action_state {
 	int next_action_frame = 0;
 
 	std::array<static_vector<unit_t*, 12>, 8> selection{};
-	std::array<std::array<static_vector<unit_id, 12>, 10>, 8> control_groups{};
+	std::array<std::array<static_vector<unit_id_32, 12>, 10>, 8> control_groups{};
+};
+
+// The actions of a replay parsed once up front, so that they can be executed any number of
+// times (seeking, repeated simulation) without going through read_action again.
+// Parameters are kept in their compact form, since unit ids can only be resolved in the state
+// the actions are executed in. Selections and chat messages are stored in payloads.
+struct decoded_actions_t {
+	struct action_t {
+		uint8_t owner;
+		action_data::compact_variant act;
+	};
+	struct block_t {
+		int frame;
+		// Offsets in the source actions data, matching action_state::actions_data_position.
+		size_t data_begin;
+		size_t data_end;
+		size_t actions_begin;
+		size_t actions_end;
+	};
+	a_vector<action_t> actions;
+	a_vector<block_t> blocks;
+	action_data::action_payloads payloads;
 };
 
 static inline action_state copy_state(const action_state& action_st, [[maybe_unused]] const state& source_st, const state& dest_st) {
@@ -72,7 +94,7 @@ struct action_functions: state_functions {
 	}
 
 	auto control_group(int owner, size_t group_n) const {
-		return make_filter_range(make_transform_range(action_st.control_groups.at(owner).at(group_n), [this](unit_id u) {
+		return make_filter_range(make_transform_range(action_st.control_groups.at(owner).at(group_n), [this](unit_id_32 u) {
 			return get_unit(u);
 		}), [](unit_t* u) {
 			return u != nullptr;
@@ -140,7 +162,7 @@ struct action_functions: state_functions {
 				auto* source_region = get_region_at_prefer_walkable(source_pos);
 				auto* target_region = get_region_at_prefer_walkable(target_pos);
 				if (!is_walkable(target_pos) || source_region->group_index != target_region->group_index) {
-					pathfinder pf;
+					pathfinder& pf = reset_pathfinder(pf_long_path_search);
 					if (pathfinder_find_long_path(pf, source_pos, target_pos)) target_region = pf.long_path.back();
 				}
 				target_pos = pathfinder_adjust_destination(target_region, target_pos);
@@ -603,7 +625,7 @@ struct action_functions: state_functions {
 				group.clear();
 				for (unit_t* u : selected_units(owner)) {
 					if (u->owner != owner) break;
-					auto uid = get_unit_id(u);
+					auto uid = get_unit_id_32(u);
 					if (group.size() == 12) error("attempt to control group more than 12 units");
 					group.push_back(uid);
 					retval = true;
@@ -615,7 +637,7 @@ struct action_functions: state_functions {
 				}
 				for (unit_t* u : selected_units(owner)) {
 					if (u->owner != owner) break;
-					auto uid = get_unit_id(u);
+					auto uid = get_unit_id_32(u);
 					if (group.empty() || unit_can_be_multi_selected(u)) {
 						auto i = std::find(group.begin(), group.end(), uid);
 						if (i == group.end()) {
@@ -788,6 +810,7 @@ struct action_functions: state_functions {
 			if (u_requires_detector(u)) continue;
 			if (u->energy < fp8::integer(tech->energy_cost)) continue;
 			u->energy -= fp8::integer(tech->energy_cost);
+			wake_unit_regen(u);
 			set_secondary_order(u, get_order_type(Orders::Cloak));
 		}
 		return retval;
@@ -1111,22 +1134,28 @@ struct action_functions: state_functions {
 		}
 	}
 
+	template<typename reader_T>
+	action_data::id_t peek_action_id(reader_T& r) {
+		auto from = r.tell();
+		action_data::id_t id;
+		if(not action_data::get(r, st, id))
+			error("read_action: no action data");
+		r.seek(from);
+		return id;
+	}
+
 	template<typename reader_T>
 	bool read_action(int owner, reader_T&& r) {
-		return std::apply([&](auto... x)
+		auto id = peek_action_id(r);
+		bool success = false;
+		if(not action_data::dispatch(id, [&](auto x)
 		{
-			bool success = false;
-			if(not (try_read_action(success, x, owner, r) || ...))
-			{
-				action_data::id_t id;
-				if(not action_data::get(r, st, id))
-					error("read_action: no action data");
-
-				error("read_action: failed to read action %d from player %d", id, owner);
-			}
-			return success;
-		},
-		action_data::all_types{});
+			return try_read_action(success, x, owner, r);
+		}))
+		{
+			error("read_action: failed to read action %d from player %d", id, owner);
+		}
+		return success;
 	}
 
 	bool read_action(const uint8_t* data, size_t data_size) {
@@ -1139,6 +1168,96 @@ struct action_functions: state_functions {
 		return read_action(owner, r);
 	}
 
+	template<typename Action, typename reader_T>
+	bool try_read_action_data(std::optional<action_data::compact_variant>& result, action_data::action_payloads& payloads, Action act, reader_T&& r)
+	{
+		auto from = r.tell();
+		auto params = Action::read_data(r, st);
+		if(params)
+		{
+			result.emplace(std::make_tuple(act, Action::to_compact(payloads, *params)));
+			return true;
+		}
+		else
+		{
+			r.seek(from);
+			return false;
+		}
+	}
+
+	template<typename reader_T>
+	action_data::compact_variant read_action_data(int owner, action_data::action_payloads& payloads, reader_T&& r) {
+		auto id = peek_action_id(r);
+		std::optional<action_data::compact_variant> result;
+		if(not action_data::dispatch(id, [&](auto x)
+		{
+			return try_read_action_data(result, payloads, x, r);
+		}))
+		{
+			error("read_action: failed to read action %d from player %d", id, owner);
+		}
+		return std::move(*result);
+	}
+
+	decoded_actions_t decode_actions(const uint8_t* actions_data_begin, const uint8_t* actions_data_end) {
+		decoded_actions_t r;
+		data_loading::data_reader_le br(actions_data_begin, actions_data_end);
+		while (br.left()) {
+			decoded_actions_t::block_t block;
+			block.data_begin = br.tell();
+			block.frame = br.get<int32_t>();
+			size_t actions_size = br.get<uint8_t>();
+			const uint8_t* ptr = br.get_n(actions_size);
+			const uint8_t* end = ptr + actions_size;
+			data_loading::data_reader_le r2(ptr, end);
+			block.actions_begin = r.actions.size();
+			while (r2.ptr != end) {
+				int player_id = r2.get<uint8_t>();
+				int owner = get_owner_id(player_id);
+				if(owner == -1)
+					error("read_action: player id %d not found", player_id);
+				r.actions.push_back({(uint8_t)owner, read_action_data(owner, r.payloads, r2)});
+			}
+			block.actions_end = r.actions.size();
+			block.data_end = br.tell();
+			r.blocks.push_back(block);
+		}
+		return r;
+	}
+
+	bool execute_decoded_action(const decoded_actions_t& decoded, const decoded_actions_t::action_t& a) {
+		return std::visit([&](auto& act)
+		{
+			auto& action_type = std::get<0>(act);
+			int owner = a.owner;
+			on_action(owner, action_data::get_primary_id(action_type.id));
+			return std::apply([&](auto... args)
+			{
+				return action(owner, action_type, args...);
+			},
+			action_type.to_func_params(st, decoded.payloads, std::get<1>(act)));
+		}, a.act);
+	}
+
+	// Equivalent to execute_actions on the data that decoded was made from.
+	void execute_decoded_actions(const decoded_actions_t& decoded) {
+		if (st.current_frame != action_st.next_action_frame) return;
+		auto i = std::lower_bound(decoded.blocks.begin(), decoded.blocks.end(), action_st.actions_data_position, [](auto& a, size_t b) {
+			return a.data_begin < b;
+		});
+		if (i != decoded.blocks.end() && i->data_begin != action_st.actions_data_position) error("execute_decoded_actions: position %d is not at the start of a block", action_st.actions_data_position);
+		for (; i != decoded.blocks.end(); ++i) {
+			if (i->frame != st.current_frame) {
+				action_st.next_action_frame = i->frame;
+				return;
+			}
+			for (size_t n = i->actions_begin; n != i->actions_end; ++n) {
+				execute_decoded_action(decoded, decoded.actions[n]);
+			}
+			action_st.actions_data_position = i->data_end;
+		}
+	}
+
 	void execute_actions(uint8_t* actions_data_begin, uint8_t* actions_data_end) {
 		if (st.current_frame != action_st.next_action_frame) return;
 		while (action_st.actions_data_position != size_t(actions_data_end - actions_data_begin)) {
@@ -7,6 +7,7 @@
 #include "data_loading.h"
 #include "bwenums.h"
 #include "korean.h"
+#include "thread_pool.h"
 
 #include <algorithm>
 #include <utility>
@@ -18,6 +19,25 @@
 
 namespace bwgame {
 
+// Define BWGAME_HEADLESS for builds that never render or play audio, like batch
+// replay processing. state_functions then drops sounds before they reach
+// play_sound(id, position, ...). Everything else is unchanged, including the random
+// numbers drawn to pick sounds, so games play out identically either way.
+// Images, overlays and frame indices are not presentation-only: they count against
+// the image limit and set the offsets weapons fire from.
+#ifdef BWGAME_HEADLESS
+static const bool headless = true;
+#else
+static const bool headless = false;
+#endif
+
+// iscript_execute dispatches instructions with computed goto, a GCC and Clang
+// extension, where it is available and with a switch otherwise. Define
+// BWGAME_NO_ISCRIPT_COMPUTED_GOTO to always use the switch.
+#if defined(__GNUC__) && !defined(BWGAME_NO_ISCRIPT_COMPUTED_GOTO)
+#define BWGAME_ISCRIPT_COMPUTED_GOTO
+#endif
+
 static const std::array<unsigned int, 64> tan_table = {
 	7, 13, 19, 26, 32, 38, 45, 51, 58, 65, 71, 78, 85, 92,
 	99, 107, 114, 122, 129, 137, 146, 154, 163, 172, 181,
@@ -83,6 +103,176 @@ static const bool psi_field_mask[5][8] = {
 
 static const std::array<int, 12> all_player_slots = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
 
+// The vision masks for each sight range, in the order that vision spreads out from the
+// center tile. They do not depend on the map, so they are generated at compile time
+// and shared by all games.
+constexpr std::array<sight_values_t, 12> generate_sight_values() {
+	std::array<sight_values_t, 12> r{};
+	for (size_t i = 0; i != r.size(); ++i) {
+		auto& v = r[i];
+		v.max_width = 3 + (int)i * 2;
+		v.max_height = 3 + (int)i * 2;
+		v.min_width = 3;
+		v.min_height = 3;
+		v.min_mask_size = 0;
+		v.ext_masked_count = 0;
+	}
+
+	struct base_mask_t {
+		size_t maskdat_index;
+		bool masked;
+	};
+	std::array<base_mask_t, 25 * 25> base_mask{};
+	auto abs = [](int v) {
+		return v < 0 ? -v : v;
+	};
+	for (auto& v : r) {
+		size_t base_mask_size = (size_t)(v.max_width * v.max_height);
+		for (auto& m : base_mask) m = {(size_t)-1, false};
+		auto mask = [&](size_t index) {
+			if (index >= base_mask_size) error("attempt to mask invalid base mask index %d (size %d)", index, base_mask_size);
+			base_mask[index].masked = true;
+		};
+		v.min_mask_size = v.min_width*v.min_height;
+		int offx = v.max_width / 2 - v.min_width / 2;
+		int offy = v.max_height / 2 - v.min_height / 2;
+		for (int y = 0; y < v.min_height; ++y) {
+			for (int x = 0; x < v.min_width; ++x) {
+				mask((offy + y)*v.max_width + offx + x);
+			}
+		}
+		auto generate_base_mask = [&]() {
+			int offset = v.max_height / 2 - v.max_width / 2;
+			int half_width = v.max_width / 2;
+			int max_x2 = half_width;
+			int max_x1 = half_width * 2;
+			int cur_x1 = 0;
+			int cur_x2 = half_width;
+			int i = 0;
+			int max_i = half_width;
+			int cursize1 = 0;
+			int cursize2 = half_width*half_width;
+			int min_cursize2 = half_width * (half_width - 1);
+			int min_cursize2_chg = half_width * 2;
+			while (true) {
+				if (cur_x1 <= max_x1) {
+					for (int i = 0; i <= max_x1 - cur_x1; ++i) {
+						mask((offset + cur_x2)*v.max_width + cur_x1 + i);
+						mask((offset + max_x2)*v.max_width + cur_x1 + i);
+					}
+				}
+				if (cur_x2 <= max_x2) {
+					for (int i = 0; i <= max_x2 - cur_x2; ++i) {
+						mask((offset + cur_x1)*v.max_width + cur_x2 + i);
+						mask((offset + max_x1)*v.max_width + cur_x2 + i);
+					}
+				}
+				cursize2 += 1 - cursize1 - 2;
+				cursize1 += 2;
+				--cur_x2;
+				++max_x2;
+				if (cursize2 <= min_cursize2) {
+					--max_i;
+					++cur_x1;
+					--max_x1;
+					min_cursize2 -= min_cursize2_chg - 2;
+					min_cursize2_chg -= 2;
+				}
+
+				++i;
+				if (i > max_i) break;
+			}
+		};
+		generate_base_mask();
+		int masked_count = 0;
+		for (size_t i = 0; i != base_mask_size; ++i) {
+			if (base_mask[i].masked) ++masked_count;
+		}
+		if ((size_t)masked_count > v.maskdat.size()) error("sight mask too large");
+
+		v.ext_masked_count = masked_count - v.min_mask_size;
+
+		size_t center_index = v.max_height / 2 * v.max_width + v.max_width / 2;
+		base_mask[center_index].maskdat_index = 0;
+
+		auto at = [&](int relative_index) -> base_mask_t& {
+			size_t index = center_index + relative_index;
+			if (index >= base_mask_size) error("attempt to access invalid base mask center-relative index %d (size %d)", index, base_mask_size);
+			return base_mask[index];
+		};
+
+		size_t next_entry_index = 1;
+
+		int cur_x = -1;
+		int cur_y = -1;
+		int added_count = 1;
+		for (int i = 2; added_count < masked_count; i += 2) {
+			for (int dir = 0; dir < 4; ++dir) {
+				const std::array<int, 4> direction_x = {1, 0, -1, 0};
+				const std::array<int, 4> direction_y = {0, 1, 0, -1};
+				int this_x = 0;
+				int this_y = 0;
+				auto do_n = [&](int n) {
+					for (int i = 0; i < n; ++i) {
+						if (at(this_y*v.max_width + this_x).masked) {
+							if (this_x || this_y) {
+								size_t this_index = next_entry_index++;
+								auto& this_entry = v.maskdat[this_index];
+
+								int prev_x = this_x;
+								int prev_y = this_y;
+								if (prev_x > 0) --prev_x;
+								else if (prev_x < 0) ++prev_x;
+								if (prev_y > 0) --prev_y;
+								else if (prev_y < 0) ++prev_y;
+								if (abs(prev_x) == abs(prev_y) || (this_x == 0 && direction_x[dir]) || (this_y == 0 && direction_y[dir])) {
+									this_entry.prev = at(prev_y * v.max_width + prev_x).maskdat_index;
+									this_entry.prev2 = (size_t)-1;
+								} else {
+									this_entry.prev = at(prev_y * v.max_width + prev_x).maskdat_index;
+									int prev2_x = prev_x;
+									int prev2_y = prev_y;
+									if (abs(prev2_x) <= abs(prev2_y)) {
+										if (this_x >= 0) ++prev2_x;
+										else --prev2_x;
+									} else {
+										if (this_y >= 0) ++prev2_y;
+										else --prev2_y;
+									}
+									this_entry.prev2 = at(prev2_y * v.max_width + prev2_x).maskdat_index;
+								}
+								this_entry.x = this_x;
+								this_entry.y = this_y;
+								at(this_y * v.max_width + this_x).maskdat_index = this_index;
+								++added_count;
+							}
+						}
+						this_x += direction_x[dir];
+						this_y += direction_y[dir];
+					}
+				};
+				const std::array<int, 4> max_i = { v.max_height,v.max_width,v.max_height,v.max_width };
+				if (i > max_i[dir]) {
+					this_x = cur_x + i * direction_x[dir];
+					this_y = cur_y + i * direction_y[dir];
+					do_n(1);
+				} else {
+					this_x = cur_x + direction_x[dir];
+					this_y = cur_y + direction_y[dir];
+					do_n(std::min(max_i[(dir + 1) % 4] - 1, i));
+				}
+				cur_x = this_x - direction_x[dir];
+				cur_y = this_y - direction_y[dir];
+			}
+			if (i < v.max_width - 1) --cur_x;
+			if (i < v.max_height - 1) --cur_y;
+		}
+	}
+	return r;
+}
+
+inline constexpr std::array<sight_values_t, 12> sight_values = generate_sight_values();
+
 inline xy_fp8 to_xy_fp8(xy position) {
 	return { fp8::integer(position.x), fp8::integer(position.y) };
 }
@@ -109,6 +299,104 @@ struct autocast {
 
 using unit_type_autocast = autocast<const unit_type_t*>;
 
+template<typename reader_T>
+void read_grp_frame_headers(grp_t& grp, reader_T r) {
+	size_t frame_count = r.template get<uint16_t>();
+	grp.width = r.template get<uint16_t>();
+	grp.height = r.template get<uint16_t>();
+	grp.frames.resize(frame_count);
+	for (size_t i = 0; i != frame_count; ++i) {
+		auto& f = grp.frames[i];
+		f.offset.x = r.template get<uint8_t>();
+		f.offset.y = r.template get<uint8_t>();
+		f.size.x = r.template get<uint8_t>();
+		f.size.y = r.template get<uint8_t>();
+		r.template get<uint32_t>();
+	}
+}
+
+template<typename reader_T>
+void read_grp_frame_data(grp_t& grp, reader_T r) {
+	auto base_r = r;
+	r.skip(6);
+	auto& data = grp.data;
+	a_vector<size_t> frame_data_offset;
+	frame_data_offset.reserve(grp.frames.size());
+	for (auto& f : grp.frames) {
+		r.skip(4);
+		size_t file_offset = r.template get<uint32_t>();
+		auto line_offset_r = base_r;
+		line_offset_r.skip(file_offset);
+		size_t frame_begin = data.size();
+		frame_data_offset.push_back(frame_begin);
+		data.resize(frame_begin + f.size.y * 4);
+		for (size_t y = 0; y != f.size.y; ++y) {
+			auto line_r = base_r;
+			line_r.skip(file_offset + line_offset_r.template get<uint16_t>());
+			uint32_t line_offset = (uint32_t)(data.size() - frame_begin);
+			memcpy(data.data() + frame_begin + y * 4, &line_offset, 4);
+			for (size_t x = 0; x != f.size.x;) {
+				auto v = line_r.template get<uint8_t>();
+				if (v & 0x80) {
+					v &= 0x7f;
+					if (v > f.size.x - x) v = (uint8_t)(f.size.x - x);
+					data.push_back(0x80 | v);
+					x += v;
+				} else if (v & 0x40) {
+					v &= 0x3f;
+					if (v > f.size.x - x) v = (uint8_t)(f.size.x - x);
+					data.push_back(0x40 | v);
+					data.push_back(line_r.template get<uint8_t>());
+					x += v;
+				} else {
+					if (v > f.size.x - x) v = (uint8_t)(f.size.x - x);
+					data.push_back(v);
+					for (size_t i = 0; i != v; ++i) {
+						data.push_back(line_r.template get<uint8_t>());
+					}
+					x += v;
+				}
+			}
+		}
+	}
+	data.shrink_to_fit();
+	for (size_t i = 0; i != grp.frames.size(); ++i) {
+		grp.frames[i].data = data.data() + frame_data_offset[i];
+	}
+}
+
+template<typename reader_T>
+grp_t read_grp(reader_T&& r) {
+	grp_t grp;
+	read_grp_frame_headers(grp, r);
+	read_grp_frame_data(grp, r);
+	return grp;
+}
+
+// Reads only the frame headers; the pixel data is decoded from the kept file data
+// the first time grp_frame is called for any frame of the grp.
+inline grp_t read_grp_lazy(a_vector<uint8_t> data) {
+	grp_t grp;
+	read_grp_frame_headers(grp, data_loading::data_reader_le(data.data(), data.data() + data.size()));
+	grp.file_data = std::move(data);
+	grp.decode_once = std::make_unique<std::once_flag>();
+	return grp;
+}
+
+// Returns frame index of grp with its pixel data (frame_t::data).
+// Frame headers (offset, size) can be read directly from grp.frames.
+// Safe to call concurrently; the grp is decoded at most once.
+inline const grp_t::frame_t& grp_frame(const grp_t& grp, size_t index) {
+	if (grp.decode_once) {
+		std::call_once(*grp.decode_once, [&]() {
+			grp_t& g = const_cast<grp_t&>(grp);
+			read_grp_frame_data(g, data_loading::data_reader_le(g.file_data.data(), g.file_data.data() + g.file_data.size()));
+			g.file_data = {};
+		});
+	}
+	return grp.frames.at(index);
+}
+
 struct global_state {
 
 	global_state() = default;
@@ -137,6 +425,9 @@ struct global_state {
 
 	std::array<a_vector<uint8_t>, 8> tileset_vf4;
 	std::array<a_vector<uint8_t>, 8> tileset_cv5;
+
+	// If set, the directory where load_map_data caches region data, keyed by the map tiles.
+	a_string regions_cache_path;
 };
 
 struct game_state {
@@ -154,7 +445,8 @@ struct game_state {
 	size_t map_width;
 	size_t map_height;
 
-	a_vector<a_string> map_strings;
+	// The STR section of the map; strings are only decoded when get_map_string asks for them.
+	a_vector<uint8_t> map_string_data;
 
 	a_string scenario_name;
 	a_string scenario_description;
@@ -168,8 +460,6 @@ struct game_state {
 	};
 	std::array<force_t, 4> forces;
 
-	std::array<sight_values_t, 12> sight_values;
-
 	size_t tileset_index;
 
 	a_vector<tile_id> gfx_tiles;
@@ -306,28 +596,32 @@ struct state_base_non_copyable {
 	intrusive_list<unit_t, void, &unit_t::cloaked_unit_link> cloaked_units;
 	intrusive_list<unit_t, psionic_matrix_link_f> psionic_matrix_units;
 
-	object_container<unit_t, 1700, 17> units_container;
+	object_container<unit_t> units_container{1700, 17};
 
 	intrusive_list<bullet_t, default_link_f> active_bullets;
-	object_container<bullet_t, 100, 10> bullets_container;
+	object_container<bullet_t> bullets_container{100, 10};
 
 	a_vector<intrusive_list<sprite_t, default_link_f>> sprites_on_tile_line;
-	object_container<sprite_t, 2500, 25> sprites_container;
+	object_container<sprite_t> sprites_container{2500, 25};
 
-	object_container<image_t, 5000, 50> images_container;
+	object_container<image_t> images_container{5000, 50};
 
-	object_container<order_t, 2000, 20> orders_container;
+	object_container<order_t> orders_container{2000, 20};
 
 	intrusive_list<path_t, default_link_f> free_paths;
-	a_list<path_t> paths;
+	object_arena<path_t> paths{1024};
 
 	intrusive_list<thingy_t, default_link_f> active_thingies;
 	intrusive_list<thingy_t, default_link_f> free_thingies;
-	a_list<thingy_t> thingies;
+	object_arena<thingy_t> thingies{500};
 
+	// Every unit in the unit finder has an entry for each edge of its bounding box,
+	// sorted by value. bb is a copy of u->unit_finder_bounding_box, so that scans over
+	// the entries do not need to touch the units themselves.
 	struct unit_finder_entry {
 		unit_t* u;
 		int value;
+		rect bb;
 	};
 	a_vector<unit_finder_entry> unit_finder_x;
 	a_vector<unit_finder_entry> unit_finder_y;
@@ -339,6 +633,48 @@ struct state_base_non_copyable {
 struct state : state_base_copyable, state_base_non_copyable {
 };
 
+// Sizes of the unit, bullet, sprite, image and order pools. The defaults are Brood
+// War's, and games only play out as in Brood War with those; larger limits are for
+// custom games and stress tests. The game itself refers to units by unit_id_32, which
+// has room for 2^27 - 1 units, but actions use unit_id, which can only refer to the
+// first 2047; get_unit_id fails for any unit past those.
+struct state_limits {
+	size_t units = 1700;
+	size_t bullets = 100;
+	size_t sprites = 2500;
+	size_t images = 5000;
+	size_t orders = 2000;
+};
+
+// Must be called before any objects have been created, ie. before a map is loaded.
+inline void set_state_limits(state& st, const state_limits& limits) {
+	if (limits.units >= (size_t)1 << unit_id_32::index_bits) error("set_state_limits: units is %d, but unit ids can only refer to %d units", limits.units, ((size_t)1 << unit_id_32::index_bits) - 1);
+	st.units_container.set_max_size(limits.units);
+	st.bullets_container.set_max_size(limits.bullets);
+	st.sprites_container.set_max_size(limits.sprites);
+	st.images_container.set_max_size(limits.images);
+	st.orders_container.set_max_size(limits.orders);
+}
+
+inline state_limits get_state_limits(const state& st) {
+	state_limits r;
+	r.units = st.units_container.max_size;
+	r.bullets = st.bullets_container.max_size;
+	r.sprites = st.sprites_container.max_size;
+	r.images = st.images_container.max_size;
+	r.orders = st.orders_container.max_size;
+	return r;
+}
+
+// A path search produces at most 50 regions and 128 positions. Path buffers are
+// reserved to that size, so that they can be passed between paths and the pathfinder
+// without reallocating.
+template<typename path_T>
+inline void reserve_path_buffers(path_T& path) {
+	path.long_path.reserve(50);
+	path.short_path.reserve(128);
+}
+
 inline bool unit_dead(const unit_t* u) {
 	if (!u->order_type) return true;
 	return u->order_type->id == Orders::Die && u->order_state == 1;
@@ -346,7 +682,13 @@ inline bool unit_dead(const unit_t* u) {
 
 inline unit_id get_unit_id(const unit_t* u) {
 	if (!u) return unit_id{};
-	return unit_id(u->index + 1, u->unit_id_generation % (1u << 5));
+	if (u->index + 1 >= (size_t)1 << unit_id::index_bits) error("get_unit_id: unit %d can not be referred to in an action", u->index);
+	return unit_id(u->index + 1, u->unit_id_generation % (1u << unit_id::generation_bits));
+}
+
+inline unit_id_32 get_unit_id_32(const unit_t* u) {
+	if (!u) return unit_id_32{};
+	return unit_id_32(u->index + 1, u->unit_id_generation % (1u << unit_id_32::generation_bits));
 }
 
 inline unit_t* get_unit(state& st, size_t index) {
@@ -356,13 +698,13 @@ inline unit_t* get_unit(state& st, size_t index) {
 	return u;
 }
 
-template<typename T>
-unit_t* get_unit(state& st, unit_id_t<T> id) {
+template<typename T, size_t index_bits>
+unit_t* get_unit(state& st, unit_id_t<T, index_bits> id) {
 	size_t idx = id.index();
 	if (!idx) return nullptr;
 	unit_t* u = get_unit(st, idx - 1);
 	if (!u) return nullptr;
-	if (u->unit_id_generation % (1u << (int_bits<T>::value - 11)) != id.generation()) return nullptr;
+	if (u->unit_id_generation % (1u << id.generation_bits) != id.generation()) return nullptr;
 	return u;
 }
 
@@ -452,6 +794,9 @@ struct state_functions {
 	state_functions(const state_functions& n) : st(n.st) {}
 
 	bool update_tiles = false;
+	// Runs iscript through the plain switch rather than the computed-goto dispatch.
+	// Both give the same results; this is for comparing them.
+	bool iscript_switch_dispatch = false;
 	flingy_t* iscript_flingy = nullptr;
 	bullet_t* iscript_bullet = nullptr;
 	unit_t* iscript_unit = nullptr;
@@ -480,14 +825,17 @@ struct state_functions {
 
 	void u_set_status_flag(unit_t* u, unit_t::status_flags_t flag) {
 		u->status_flags |= flag;
+		if (flag & regen_status_flags) wake_unit_regen(u);
 	}
 	void u_unset_status_flag(unit_t* u, unit_t::status_flags_t flag) {
 		u->status_flags &= ~flag;
+		if (flag & regen_status_flags) wake_unit_regen(u);
 	}
 
 	void u_set_status_flag(unit_t* u, unit_t::status_flags_t flag, bool value) {
 		if (value) u->status_flags |= flag;
 		else u->status_flags &= ~flag;
+		if (flag & regen_status_flags) wake_unit_regen(u);
 	}
 
 	void u_set_movement_flag(flingy_t* u, int flag) {
@@ -711,6 +1059,7 @@ struct state_functions {
 	std::optional<int> sound_owner = std::nullopt;
 
 	void play_sound(int id, const unit_t* source_unit, bool add_race_index = false) {
+		if (headless) return;
 		if(not source_unit)
 		{
 			play_sound(id, xy(), nullptr, add_race_index);
@@ -722,11 +1071,13 @@ struct state_functions {
 	}
 
 	void play_sound(int id, const sprite_t* sprite) {
+		if (headless) return;
 		if(not sound_owner || not sprite || is_visible(*sound_owner, sprite))
 			play_sound(id, sprite ? sprite->position : xy());
 	}
 
 	void play_sound(int id, bool add_race_index = false) {
+		if (headless) return;
 		play_sound(id, xy(), nullptr, add_race_index);
 	}
 
@@ -734,8 +1085,8 @@ struct state_functions {
 		return bwgame::get_unit(st, index);
 	}
 
-	template<typename T>
-	unit_t* get_unit(unit_id_t<T> id) const {
+	template<typename T, size_t index_bits>
+	unit_t* get_unit(unit_id_t<T, index_bits> id) const {
 		return bwgame::get_unit(st, id);
 	}
 
@@ -744,8 +1095,7 @@ struct state_functions {
 	}
 
 	unit_id_32 get_unit_id_32(const unit_t* u) const {
-		if (!u) return unit_id_32{};
-		return unit_id_32(u->index + 1, u->unit_id_generation % (1u << 21));
+		return bwgame::get_unit_id_32(u);
 	}
 
 	bool is_in_map_bounds(const unit_type_t* unit_type, xy pos) const {
@@ -1023,6 +1373,7 @@ struct state_functions {
 
 	void set_unit_hp(unit_t* u, fp8 hitpoints) {
 		u->hp = std::min(hitpoints, u->unit_type->hitpoints);
+		wake_unit_regen(u);
 		if (u_completed(u)) {
 			update_unit_damage_overlay(u);
 
@@ -1033,10 +1384,12 @@ struct state_functions {
 
 	void set_unit_shield_points(unit_t* u, fp8 shield_points) {
 		u->shield_points = std::min(shield_points, fp8::integer(u->unit_type->shield_points));
+		wake_unit_regen(u);
 	}
 
 	void set_unit_energy(unit_t* u, fp8 energy) {
 		u->energy = std::min(energy, unit_max_energy(u));
+		wake_unit_regen(u);
 	}
 
 	bool unit_is_mineral_field(unit_type_autocast ut) const {
@@ -1183,7 +1536,15 @@ struct state_functions {
 		destroy_image_from_to(u, ImageTypes::IMAGEID_Acid_Spores_1_Overlay_Small, ImageTypes::IMAGEID_Acid_Spores_6_9_Overlay_Large);
 	}
 
+	bool unit_has_status_timers(const unit_t* u) const {
+		int timers = u->stasis_timer | u->stim_timer | u->ensnare_timer | u->defensive_matrix_timer | u->irradiate_timer;
+		timers |= u->lockdown_timer | u->maelstrom_timer | u->plague_timer | u->storm_timer | u->acid_spore_count;
+		return timers != 0;
+	}
+
 	void update_unit_status_timers(unit_t* u) {
+		// Almost every unit has none of these effects, so test them all at once first.
+		if (!unit_has_status_timers(u)) return;
 		if (u->stasis_timer) {
 			--u->stasis_timer;
 			if (!u->stasis_timer) {
@@ -1304,12 +1665,43 @@ struct state_functions {
 		return hp * 100 / max_hp;
 	}
 
+	// The status flags that unit_regen_is_idle depends on.
+	static const int regen_status_flags = unit_t::status_flag_completed | unit_t::status_flag_grounded_building | unit_t::status_flag_requires_detector | unit_t::status_flag_cloaked | unit_t::status_flag_passively_cloaked | unit_t::status_flag_hallucination;
+
+	// Must be called whenever anything that unit_regen_is_idle looks at changes: the unit's
+	// hit points, shields, energy, type, owner, one of regen_status_flags or the owner's
+	// upgrades. The unit then goes through the regeneration updates again until they have
+	// nothing left to do.
+	void wake_unit_regen(unit_t* u) {
+		u->regen_idle = false;
+	}
+
+	// Whether the shield, hit point, energy and burning updates in update_unit_values would
+	// leave the unit unchanged.
+	bool unit_regen_is_idle(const unit_t* u) const {
+		if (u->unit_type->has_shield && u->shield_points != fp8::integer(u->unit_type->shield_points)) return false;
+		if (!u_completed(u)) return true;
+		if (ut_regens_hp(u) && u->hp > 0_fp8 && u->hp != u->unit_type->hitpoints) return false;
+		if (ut_has_energy(u) && !u_hallucination(u)) {
+			if ((u_cloaked(u) || u_requires_detector(u)) && !u_passively_cloaked(u)) return false;
+			// The energy limit of a Dark Archon depends on its order while it is being summoned.
+			if (unit_is(u, UnitTypes::Protoss_Dark_Archon)) return false;
+			if (u->energy != unit_max_energy(u)) return false;
+		}
+		if (unit_race(u) == race_t::terran && (u_grounded_building(u) || ut_flying_building(u))) {
+			if (unit_hp_percent(u) <= 33) return false;
+		}
+		return true;
+	}
+
 	void update_unit_values(unit_t* u) {
 		if (u->main_order_timer) --u->main_order_timer;
 		if (u->ground_weapon_cooldown) --u->ground_weapon_cooldown;
 		if (u->air_weapon_cooldown) --u->air_weapon_cooldown;
 		if (u->spell_cooldown) --u->spell_cooldown;
-		if (u->unit_type->has_shield) {
+		// regen_idle is tested right before each update it guards, since the updates in
+		// between (status timers in particular) can wake the unit.
+		if (!u->regen_idle && u->unit_type->has_shield) {
 			fp8 max_shields = fp8::integer(u->unit_type->shield_points);
 			if (u->shield_points != max_shields) {
 				u->shield_points += 7_fp8;
@@ -1328,16 +1720,18 @@ struct state_functions {
 			}
 		}
 		if (u_completed(u)) {
-			if (ut_regens_hp(u)) {
-				if (u->hp > 0_fp8 && u->hp != u->unit_type->hitpoints) {
-					set_unit_hp(u, u->hp + 4_fp8);
+			if (!u->regen_idle) {
+				if (ut_regens_hp(u)) {
+					if (u->hp > 0_fp8 && u->hp != u->unit_type->hitpoints) {
+						set_unit_hp(u, u->hp + 4_fp8);
+					}
 				}
+				update_unit_energy(u);
 			}
-			update_unit_energy(u);
 			if (u->move_target_timer) --u->move_target_timer;
 			if (u->remove_timer != 0 && --u->remove_timer == 0) {
 				kill_unit(u);
-			} else {
+			} else if (!u->regen_idle) {
 				if (unit_race(u) == race_t::terran) {
 					if (u_grounded_building(u) || ut_flying_building(u)) {
 						if (unit_hp_percent(u) <= 33) {
@@ -1347,6 +1741,7 @@ struct state_functions {
 				}
 			}
 		}
+		if (!u->regen_idle) u->regen_idle = unit_regen_is_idle(u);
 	}
 
 	unit_t* unit_turret(const unit_t* u) const {
@@ -2166,7 +2561,7 @@ struct state_functions {
 
 	int long_path_distance(xy from, xy to) const {
 		if (!is_reachable(from, to)) return 0x7fff;
-		pathfinder pf;
+		pathfinder& pf = reset_pathfinder(pf_long_path_search);
 		if (!pathfinder_find_long_path(pf, from, to)) return 0x7ffe;
 		if (pf.long_path.size() <= 2) return xy_length(to - from);
 		xy pos = to_xy(pf.long_path[0]->center);
@@ -2590,6 +2985,73 @@ struct state_functions {
 		return false;
 	}
 
+	// The psionic matrix at tile resolution, for update_psionic_matrix. Bit n of a tile
+	// is set if a pylon owned by player n powers all of it, and bit 12 + n if one only
+	// powers part of it, in which case the pylons are checked individually. That happens
+	// on the outermost pixels of a field and around pylons that are not tile aligned.
+	// pylons holds the pylons the tiles were made from, to tell when they are out of date.
+	struct psionic_matrix_tiles_t {
+		struct pylon_t {
+			const unit_t* u;
+			int owner;
+			xy pos;
+		};
+		a_vector<pylon_t> pylons;
+		a_vector<uint32_t> tiles;
+	};
+	psionic_matrix_tiles_t psionic_matrix_tiles;
+
+	void update_psionic_matrix_tiles() {
+		auto& m = psionic_matrix_tiles;
+		size_t width = game_st.map_tile_width;
+		size_t height = game_st.map_tile_height;
+		bool up_to_date = m.tiles.size() == width * height;
+		auto pi = m.pylons.begin();
+		for (const unit_t* u : ptr(st.psionic_matrix_units)) {
+			if (!up_to_date) break;
+			if (pi == m.pylons.end() || pi->u != u || pi->owner != u->owner || pi->pos != u->sprite->position) up_to_date = false;
+			else ++pi;
+		}
+		if (up_to_date && pi == m.pylons.end()) return;
+
+		m.pylons.clear();
+		m.tiles.assign(width * height, 0);
+		for (const unit_t* u : ptr(st.psionic_matrix_units)) {
+			xy pos = u->sprite->position;
+			m.pylons.push_back({u, u->owner, pos});
+			bool aligned = pos.x % 32 == 0 && pos.y % 32 == 0;
+			int from_x = std::max(pos.x - 256, 0) / 32;
+			int from_y = std::max(pos.y - 160, 0) / 32;
+			int to_x = std::min(pos.x + 255, (int)game_st.map_width - 1) / 32;
+			int to_y = std::min(pos.y + 159, (int)game_st.map_height - 1) / 32;
+			for (int y = from_y; y <= to_y; ++y) {
+				for (int x = from_x; x <= to_x; ++x) {
+					// Around an aligned pylon, a tile is either powered, unpowered or
+					// powered except for its outermost row or column of pixels, which
+					// the corners tell apart.
+					int corners = 4;
+					if (aligned) {
+						xy rel = xy(x * 32, y * 32) - pos;
+						corners = is_in_psionic_matrix_range(rel) + is_in_psionic_matrix_range(rel + xy(31, 0));
+						corners += is_in_psionic_matrix_range(rel + xy(0, 31)) + is_in_psionic_matrix_range(rel + xy(31, 31));
+						if (corners == 0) continue;
+					}
+					auto& v = m.tiles[y * width + x];
+					if (corners == 4 && aligned) v |= 1u << u->owner;
+					else v |= 1u << (12 + u->owner);
+				}
+			}
+		}
+	}
+
+	bool psionic_matrix_tiles_has_power(int owner, xy pos) const {
+		if ((size_t)pos.x >= game_st.map_width || (size_t)pos.y >= game_st.map_height) return is_in_psionic_matrix(owner, pos);
+		uint32_t v = psionic_matrix_tiles.tiles[(size_t)pos.y / 32u * game_st.map_tile_width + (size_t)pos.x / 32u];
+		if (v & (1u << owner)) return true;
+		if (v & (1u << (12 + owner))) return is_in_psionic_matrix(owner, pos);
+		return false;
+	}
+
 	bool can_place_building(const unit_t* u, int owner, const unit_type_t* unit_type, xy pos, bool check_undetected_units, bool check_invisible_tiles) const {
 		xy_t<size_t> tile_pos;
 		tile_pos.x = (pos.x - unit_type->placement_size.x / 2) / 32u;
@@ -2976,6 +3438,7 @@ struct state_functions {
 		st.player_units[u->owner].remove(*u);
 		u->owner = owner;
 		st.player_units[owner].push_front(*u);
+		wake_unit_regen(u);
 		increment_unit_counts(u, 1);
 		if (u_completed(u)) add_completed_unit(u, 1, increment_score);
 		if (is_morphing) u_unset_status_flag(u, unit_t::status_flag_completed);
@@ -3041,6 +3504,7 @@ struct state_functions {
 		int hp = prev_max_hp ? prev_hp.integer_part() * u->unit_type->hitpoints.integer_part() / prev_max_hp : 1;
 		if (hp == 0) u->hp = 1_fp8;
 		else u->hp = fp8::integer(hp);
+		wake_unit_regen(u);
 		u->air_strength = get_unit_strength(u, false);
 		u->ground_strength = get_unit_strength(u, true);
 		u->sprite->owner = prev_sprite_owner;
@@ -3130,6 +3594,7 @@ struct state_functions {
 		morph_unit(target, unit_type);
 		create_image(get_image_type(ImageTypes::IMAGEID_Vespene_Geyser2), target->sprite, {}, image_order_below);
 		target->hp = unit_type->hitpoints / 10;
+		wake_unit_regen(target);
 		return target;
 	}
 
@@ -3184,7 +3649,7 @@ struct state_functions {
 			}
 		}
 		play_sound(40 + (int)unit_race(u), u);
-		u->loaded_units.at(index) = get_unit_id(target);
+		u->loaded_units.at(index) = get_unit_id_32(target);
 		target->connected_unit = u;
 		u_set_status_flag(target, unit_t::status_flag_loaded);
 		hide_unit(target);
@@ -3207,7 +3672,7 @@ struct state_functions {
 		if (!u_loaded(u)) return;
 		unit_t* container = u->connected_unit;
 		if (container) {
-			auto uid = get_unit_id(u);
+			auto uid = get_unit_id_32(u);
 			size_t index = (size_t)-1;
 			for (size_t i = 0; i != container->unit_type->space_provided; ++i) {
 				if (container->loaded_units[i] == uid) {
@@ -3215,7 +3680,7 @@ struct state_functions {
 					break;
 				}
 			}
-			container->loaded_units.at(index) = unit_id();
+			container->loaded_units.at(index) = unit_id_32();
 			u->connected_unit = nullptr;
 			u_unset_status_flag(u, unit_t::status_flag_loaded);
 
@@ -3616,6 +4081,7 @@ struct state_functions {
 	void apply_upgrades_to_player_units(int owner) {
 		for (unit_t* u : ptr(st.player_units[owner])) {
 			update_unit_speed_upgrades(u);
+			wake_unit_regen(u);
 		}
 	}
 
@@ -3887,6 +4353,7 @@ struct state_functions {
 		fp8 energy_required = heal_amount / 2;
 		if (u->energy < energy_required) return 2;
 		u->energy -= energy_required;
+		wake_unit_regen(u);
 		set_unit_hp(target, target->hp + heal_amount);
 		target->is_being_healed = true;
 		return 1;
@@ -4069,6 +4536,7 @@ struct state_functions {
 		add_creep_provider(u);
 		set_construction_graphic(u, true);
 		u->hp = u->unit_type->hitpoints / 10;
+		wake_unit_regen(u);
 		if (!u->build_queue.empty()) u->build_queue.erase(u->build_queue.begin());
 		set_unit_order(u, get_order_type(Orders::IncompleteMorphing));
 	}
@@ -4272,6 +4740,7 @@ struct state_functions {
 			return nullptr;
 		}
 		u->hp = u->unit_type->hitpoints;
+		wake_unit_regen(u);
 		make_unit_hallucination(u);
 		set_unit_order(u, u->unit_type->human_ai_idle);
 		if (unit_is_reaver(source_unit) && unit_is_reaver(u)) {
@@ -5916,6 +6385,7 @@ struct state_functions {
 			complete_unit(scan);
 			order_done(u);
 			u->energy -= energy_cost;
+			wake_unit_regen(u);
 			play_sound(388, u);
 		} else {
 			display_last_error_for_player(u->owner);
@@ -5957,6 +6427,7 @@ struct state_functions {
 		auto* tech = get_tech_type(TechTypes::Defensive_Matrix);
 		if (spell_cast_target_movement(u, tech, unit_sight_range(u, true))) {
 			u->energy -= fp8::integer(tech->energy_cost);
+			wake_unit_regen(u);
 			unit_t* target = u->order_target.unit;
 			target->defensive_matrix_hp = fp8::integer(250);
 			target->defensive_matrix_timer = 168;
@@ -6011,7 +6482,10 @@ struct state_functions {
 		if (is_in_range()) {
 			if (!u_movement_flag(u, 4)) stop_unit(u);
 			if (u->spell_cooldown == 0 && unit_can_fire_weapon(u, weapon) && !u_movement_flag(u, 2) && unit_is_at_move_target(u)) {
-				if (tech) u->energy -= fp8::integer(tech->energy_cost);
+				if (tech) {
+					u->energy -= fp8::integer(tech->energy_cost);
+					wake_unit_regen(u);
+				}
 				u->spell_cooldown = get_modified_weapon_cooldown(u, weapon) + (lcg_rand(49) & 3) - 1;
 				u_set_movement_flag(u, 8);
 				u->order_signal &= ~2;
@@ -6794,6 +7268,7 @@ struct state_functions {
 		if (exit) {
 			set_construction_graphic(exit, true);
 			exit->hp = exit->unit_type->hitpoints / 10;
+			wake_unit_regen(exit);
 			set_unit_order(exit, get_order_type(Orders::IncompleteMorphing));
 			add_creep_provider(exit);
 			if (unit_is_nydus(u)) u->building.nydus.exit = exit;
@@ -6926,6 +7401,7 @@ struct state_functions {
 		increment_unit_counts(u, -1);
 		if (u_completed(u)) add_completed_unit(u, -1, false);
 		u->unit_type = new_type;
+		wake_unit_regen(u);
 		increment_unit_counts(u, 1);
 		if (u_completed(u)) add_completed_unit(u, 1, false);
 		set_unit_owner(u, queen->owner, true);
@@ -7180,7 +7656,10 @@ struct state_functions {
 			u->sprite->flags &= ~sprite_t::flag_iscript_nobrk;
 			sprite_run_anim(u->sprite, iscript_anims::SpecialState1);
 			u->kill_count += target->kill_count;
-			if (is_dark_archon) u->energy = fp8::integer(50);
+			if (is_dark_archon) {
+				u->energy = fp8::integer(50);
+				wake_unit_regen(u);
+			}
 			target->user_action_flags |= 4;
 			kill_unit(target);
 			u_unset_status_flag(u, unit_t::status_flag_can_move);
@@ -7229,6 +7708,8 @@ struct state_functions {
 		}
 	}
 
+	a_vector<unit_t*> recall_targets;
+
 	void order_CastRecall(unit_t* u) {
 		if (u->order_state == 0) {
 			if (u->energy < fp8::integer(get_tech_type(TechTypes::Recall)->energy_cost)) {
@@ -7237,6 +7718,7 @@ struct state_functions {
 				return;
 			}
 			u->energy -= fp8::integer(get_tech_type(TechTypes::Recall)->energy_cost);
+			wake_unit_regen(u);
 			if (u->order_target.unit) u->order_target.pos = u->order_target.unit->sprite->position;
 			thingy_t* t = create_thingy(get_sprite_type(SpriteTypes::SPRITEID_Recall_Field), u->order_target.pos, 0);
 			if (t) {
@@ -7248,7 +7730,8 @@ struct state_functions {
 			u->order_state = 1;
 		} else if (u->order_state == 1 && u->main_order_timer == 0) {
 			int n_recalled = 0;
-			a_vector<unit_t*> targets;
+			auto& targets = recall_targets;
+			targets.clear();
 			for (unit_t* target : find_units_noexpand(square_at(u->order_target.pos, 64))) {
 				if (target == u) continue;
 				if (target->owner != u->owner) continue;
@@ -7310,6 +7793,7 @@ struct state_functions {
 			unit_t* fighter = release_fighter(u);
 			if (fighter) {
 				fighter->shield_points = fp8::integer(fighter->unit_type->shield_points);
+				wake_unit_regen(fighter);
 				fighter->sprite->elevation_level = u->sprite->elevation_level - 1;
 				set_unit_order(fighter, fighter->unit_type->attack_unit, u->order_target.unit);
 				u->main_order_timer = 7;
@@ -7467,11 +7951,15 @@ struct state_functions {
 			else {
 				create_sized_image(target, ImageTypes::IMAGEID_Mind_Control_Hit_Small);
 				trigger_give_unit_to(target, u->owner);
-				if (unit_is(target, UnitTypes::Protoss_Dark_Archon)) target->energy = 0_fp8;
+				if (unit_is(target, UnitTypes::Protoss_Dark_Archon)) {
+					target->energy = 0_fp8;
+					wake_unit_regen(target);
+				}
 				order_done(target);
 			}
 			u->energy -= fp8::integer(tech->energy_cost);
 			u->shield_points = 0_fp8;
+			wake_unit_regen(u);
 			order_done(u);
 			play_sound(1062, target);
 		}
@@ -7608,6 +8096,7 @@ struct state_functions {
 			}
 			set_unit_shield_points(u, u->shield_points + shield_recharge);
 			target->energy -= energy_cost;
+			wake_unit_regen(target);
 
 			if (u->shield_points >= fp8::integer(u->unit_type->shield_points) || target->energy == 0_fp8) {
 				if (target->order_target.unit == u) target->order_target.unit = nullptr;
@@ -7648,6 +8137,8 @@ struct state_functions {
 				weapon_deal_damage(get_weapon_type(WeaponTypes::Feedback), target->energy, 1, target, 1_dir, u, u->owner);
 				target->energy = 0_fp8;
 				u->energy -= fp8::integer(tech->energy_cost);
+				wake_unit_regen(target);
+				wake_unit_regen(u);
 				play_sound(1061, target);
 				if (unit_dying(target)) {
 					SpriteTypes sprite_id = (SpriteTypes)((int)SpriteTypes::SPRITEID_Feedback_Hit_Small + unit_sprite_size(target));
@@ -7685,6 +8176,7 @@ struct state_functions {
 				show_unit(n);
 			}
 			u->energy -= fp8::integer(tech->energy_cost);
+			wake_unit_regen(u);
 			play_sound(618, u->order_target.unit);
 			create_image(get_image_type(ImageTypes::IMAGEID_Hallucination_Hit), (target->subunit ? target->subunit : target)->sprite, {}, image_order_top);
 			order_done(u);
@@ -8529,12 +9021,32 @@ struct state_functions {
 		}
 	}
 
+	// Resources, idle buildings, critters and the like: no main or secondary order
+	// work to do, so execute_main_order and execute_secondary_order would only count
+	// down the order timers.
+	bool unit_orders_are_dormant(const unit_t* u) const {
+		if (u->order_type->id != Orders::Nothing || !u->order_queue.empty()) return false;
+		if (u->secondary_order_type->id != Orders::Nothing) return false;
+		return !unit_is_disabled(u);
+	}
+
+	void update_dormant_unit_orders(unit_t* u) {
+		if (!u_can_move(u) && u_cannot_attack(u)) {
+			if (u->main_order_timer == 0) u->main_order_timer = 15;
+		}
+		if (u->order_process_timer) --u->order_process_timer;
+		else u->order_process_timer = 8;
+	}
+
 	void update_unit(unit_t* u) {
 
 		update_unit_values(u);
 
-		execute_main_order(u);
-		execute_secondary_order(u);
+		if (unit_orders_are_dormant(u)) update_dormant_unit_orders(u);
+		else {
+			execute_main_order(u);
+			execute_secondary_order(u);
+		}
 
 		if (u->subunit && !ut_turret(u)) {
 			auto ius = make_thingy_setter(iscript_unit, u->subunit);
@@ -9089,7 +9601,7 @@ struct state_functions {
 			for (auto i = std::upper_bound(arr.begin(), arr.end(), u->unit_finder_bounding_box.from.x, cmp_u); i != arr.begin();) {
 				--i;
 				if (i->value < new_bb.from.x) break;
-				if (i->u->unit_finder_bounding_box.from.y <= new_bb.to.y && i->u->unit_finder_bounding_box.to.y >= new_bb.from.y) {
+				if (i->bb.from.y <= new_bb.to.y && i->bb.to.y >= new_bb.from.y) {
 					if (unit_can_collide_with(u, i->u) && u_ground_unit(i->u)) {
 						return i->u;
 					}
@@ -9099,7 +9611,7 @@ struct state_functions {
 			auto& arr = st.unit_finder_x;
 			for (auto i = std::lower_bound(arr.begin(), arr.end(), u->unit_finder_bounding_box.to.x, cmp_l); i != arr.end(); ++i) {
 				if (i->value > new_bb.to.x) break;
-				if (i->u->unit_finder_bounding_box.from.y <= new_bb.to.y && i->u->unit_finder_bounding_box.to.y >= new_bb.from.y) {
+				if (i->bb.from.y <= new_bb.to.y && i->bb.to.y >= new_bb.from.y) {
 					if (unit_can_collide_with(u, i->u) && u_ground_unit(i->u)) {
 						return i->u;
 					}
@@ -9111,7 +9623,7 @@ struct state_functions {
 			for (auto i = std::upper_bound(arr.begin(), arr.end(), u->unit_finder_bounding_box.from.y, cmp_u); i != arr.begin();) {
 				--i;
 				if (i->value < new_bb.from.y) break;
-				if (i->u->unit_finder_bounding_box.from.x <= new_bb.to.x && i->u->unit_finder_bounding_box.to.x >= new_bb.from.x) {
+				if (i->bb.from.x <= new_bb.to.x && i->bb.to.x >= new_bb.from.x) {
 					if (unit_can_collide_with(u, i->u) && u_ground_unit(i->u)) {
 						return i->u;
 					}
@@ -9121,7 +9633,7 @@ struct state_functions {
 			auto& arr = st.unit_finder_y;
 			for (auto i = std::lower_bound(arr.begin(), arr.end(), u->unit_finder_bounding_box.to.y, cmp_l); i != arr.end(); ++i) {
 				if (i->value > new_bb.to.y) break;
-				if (i->u->unit_finder_bounding_box.from.x <= new_bb.to.x && i->u->unit_finder_bounding_box.to.x >= new_bb.from.x) {
+				if (i->bb.from.x <= new_bb.to.x && i->bb.to.x >= new_bb.from.x) {
 					if (unit_can_collide_with(u, i->u) && u_ground_unit(i->u)) {
 						return i->u;
 					}
@@ -9271,26 +9783,83 @@ struct state_functions {
 		bool consider_collision_with_moving_units = false;
 	};
 
+	struct pf_long_node {
+		pf_long_node* prev = nullptr;
+		xy_fp8 pos;
+		const regions_t::region* region = nullptr;
+		fp8 total_cost{};
+		fp8 estimated_remaining_cost{};
+		fp8 estimated_final_cost{};
+		bool visited = false;
+	};
+
+	struct pf_search {
+		const unit_t* u = nullptr;
+		const unit_t* target_unit = nullptr;
+		std::array<int, 4> inner;
+		std::array<int, 4> outer;
+		rect target_unit_bb;
+		xy target;
+
+		bool has_found_goal;
+		xy cur_pos;
+		xy cur_pos_max;
+		xy cur_pos_min;
+
+		std::array<a_vector<regions_t::contour>, 4> local_edges;
+
+		std::array<const regions_t::contour*, 4> nearest_edge;
+
+		struct neighbor_t {
+			xy pos;
+			int flags;
+			bool is_goal;
+		};
+		static_vector<neighbor_t, 32> neighbors;
+
+		a_vector<rect> visited_areas;
+	};
+
+	// The pathfinder's working storage is kept between searches, so that it is only
+	// allocated while it grows. pf_path_progress is used by path_progress, and
+	// pf_long_path_search by searches that only need the long path. They are reset
+	// before each use but keep the storage of their path buffers, which path_progress
+	// swaps with those of the paths it takes over or produces.
+	mutable a_vector<pf_long_node> pf_long_nodes;
+	mutable a_vector<pf_long_node*> pf_long_open;
+	mutable pf_search pf_short_search;
+	mutable pathfinder pf_path_progress;
+	mutable pathfinder pf_long_path_search;
+
+	pathfinder& reset_pathfinder(pathfinder& pf) const {
+		auto long_path = std::move(pf.long_path);
+		auto short_path = std::move(pf.short_path);
+		pf = pathfinder();
+		long_path.clear();
+		short_path.clear();
+		pf.long_path = std::move(long_path);
+		pf.short_path = std::move(short_path);
+		reserve_path_buffers(pf);
+		return pf;
+	}
+
 	bool pathfinder_find_long_path(pathfinder& pf) const {
 		if (pf.source_region == pf.destination_region) return false;
 
-		struct node_t {
-			node_t* prev = nullptr;
-			xy_fp8 pos;
-			const regions_t::region* region = nullptr;
-			fp8 total_cost{};
-			fp8 estimated_remaining_cost{};
-			fp8 estimated_final_cost{};
-			bool visited = false;
-		};
+		using node_t = pf_long_node;
 		struct cmp_node {
 			bool operator()(const node_t* a, const node_t* b) const {
 				return a->estimated_final_cost < b->estimated_final_cost;
 			}
 		};
-		a_vector<node_t*> open;
+		auto& open = pf_long_open;
+		open.clear();
 
-		a_list<node_t> all_nodes;
+		// Nodes are referred to by pointer, so all_nodes must never reallocate. The first
+		// search stops at 350 nodes, and the second makes at most one per region.
+		auto& all_nodes = pf_long_nodes;
+		all_nodes.clear();
+		all_nodes.reserve(350 + game_st.regions.regions.size());
 
 		node_t* goal_node = nullptr;
 
@@ -9304,6 +9873,7 @@ struct state_functions {
 
 			xy_fp8 to_pos = region_pos(to_region);
 
+			if (all_nodes.size() == all_nodes.capacity()) error("pathfinder_find_long_path: too many nodes");
 			all_nodes.emplace_back();
 			node_t* start_node = &all_nodes.back();
 			start_node->pos = region_pos(from_region);
@@ -9338,6 +9908,7 @@ struct state_functions {
 					fp8 total_cost = cur->total_cost + cost;
 					node_t* n = (node_t*)r->pathfinder_node;
 					if (!n) {
+						if (all_nodes.size() == all_nodes.capacity()) error("pathfinder_find_long_path: too many nodes");
 						all_nodes.emplace_back();
 						n = &all_nodes.back();
 						n->prev = cur;
@@ -9514,34 +10085,7 @@ struct state_functions {
 			nr->pathfinder_flag = 1;
 		}
 
-		struct pf_search {
-			const unit_t* u = nullptr;
-			const unit_t* target_unit = nullptr;
-			std::array<int, 4> inner;
-			std::array<int, 4> outer;
-			rect target_unit_bb;
-			xy target;
-
-			bool has_found_goal;
-			xy cur_pos;
-			xy cur_pos_max;
-			xy cur_pos_min;
-
-			std::array<a_vector<regions_t::contour>, 4> local_edges;
-
-			std::array<const regions_t::contour*, 4> nearest_edge;
-
-			struct neighbor_t {
-				xy pos;
-				int flags;
-				bool is_goal;
-			};
-			static_vector<neighbor_t, 32> neighbors;
-
-			a_vector<rect> visited_areas;
-		};
-
-		pf_search w;
+		pf_search& w = pf_short_search;
 
 		w.u = pf.u;
 		w.target_unit = pf.target_unit;
@@ -9591,10 +10135,10 @@ struct state_functions {
 
 		struct visited {
 			int x;
-			a_vector<std::pair<int, int>> y;
+			static_vector<std::pair<int, int>, 10> y;
 		};
 
-		a_vector<visited> pf_area_visited;
+		static_vector<visited, 128 + 1> pf_area_visited;
 		pf_area_visited.push_back({0, {}});
 		pf_area_visited.push_back({(int)game_st.map_width, {}});
 
@@ -9732,7 +10276,7 @@ struct state_functions {
 				return a.value < b;
 			};
 			for (auto i = std::lower_bound(st.unit_finder_y.begin(), st.unit_finder_y.end(), w.cur_pos_min.y - w.inner[0] - 1, cmp_l); i != st.unit_finder_y.end(); ++i) {
-				auto& bb = i->u->unit_finder_bounding_box;
+				auto& bb = i->bb;
 				if (i->value >= w.cur_pos.y - w.inner[0]) break;
 				if (i->value == bb.to.y) {
 					regions_t::contour c;
@@ -9749,7 +10293,7 @@ struct state_functions {
 				}
 			}
 			for (auto i = std::lower_bound(st.unit_finder_x.begin(), st.unit_finder_x.end(), w.cur_pos.x - w.inner[1], cmp_l); i != st.unit_finder_x.end(); ++i) {
-				auto& bb = i->u->unit_finder_bounding_box;
+				auto& bb = i->bb;
 				if (i->value > w.cur_pos_max.x - w.inner[1] + 1) break;
 				if (i->value == bb.from.x) {
 					regions_t::contour c;
@@ -9766,7 +10310,7 @@ struct state_functions {
 				}
 			}
 			for (auto i = std::lower_bound(st.unit_finder_y.begin(), st.unit_finder_y.end(), w.cur_pos.y - w.inner[2], cmp_l); i != st.unit_finder_y.end(); ++i) {
-				auto& bb = i->u->unit_finder_bounding_box;
+				auto& bb = i->bb;
 				if (i->value > w.cur_pos_max.y - w.inner[2] + 1) break;
 				if (i->value == bb.from.y) {
 					regions_t::contour c;
@@ -9783,7 +10327,7 @@ struct state_functions {
 				}
 			}
 			for (auto i = std::lower_bound(st.unit_finder_x.begin(), st.unit_finder_x.end(), w.cur_pos_min.x - w.inner[3] - 1, cmp_l); i != st.unit_finder_x.end(); ++i) {
-				auto& bb = i->u->unit_finder_bounding_box;
+				auto& bb = i->bb;
 				if (i->value >= w.cur_pos.x - w.inner[3]) break;
 				if (i->value == bb.to.x) {
 					regions_t::contour c;
@@ -10837,8 +11381,10 @@ struct state_functions {
 			st.free_paths.pop_front();
 			return r;
 		}
-		if (st.paths.size() >= 1024) return nullptr;
-		return &*st.paths.emplace(st.paths.end());
+		if (st.paths.size() >= st.paths.max_size) return nullptr;
+		path_t* r = st.paths.emplace();
+		reserve_path_buffers(*r);
+		return r;
 	}
 
 	void free_path(unit_t* u) {
@@ -10854,7 +11400,7 @@ struct state_functions {
 	bool path_progress(unit_t* u, xy to, const unit_t* consider_collision_with_unit = nullptr, bool consider_collision_with_moving_units = false) {
 		u_unset_movement_flag(u, 0x40);
 		u_set_movement_flag(u, 0x10);
-		pathfinder pf;
+		pathfinder& pf = reset_pathfinder(pf_path_progress);
 		pf.consider_collision_with_unit = consider_collision_with_unit;
 		pf.consider_collision_with_moving_units = consider_collision_with_moving_units;
 		bool find_new_path = true;
@@ -11575,7 +12121,7 @@ struct state_functions {
 				}
 			}
 			if (fix_collision) {
-				u->path->last_collision_unit = get_unit_id(collision_unit);
+				u->path->last_collision_unit = get_unit_id_32(collision_unit);
 				u->path->last_collision_speed = speed;
 				u->movement_state = movement_states::UM_FixCollision;
 				return true;
@@ -12401,7 +12947,7 @@ struct state_functions {
 		const size_t max_width = 11 * 2 + 3;
 		std::array<uint32_t, max_width * max_width> vision_propagation;
 		uint32_t required_tile_mask = (uint32_t)height_mask << 16 | (uint32_t)(uint8_t)~visibility_mask << 8 | (uint32_t)(uint8_t)~visibility_mask;
-		const auto& sight_vals = game_st.sight_values.at(range);
+		const auto& sight_vals = sight_values.at(range);
 		size_t tile_x = (size_t)pos.x / 32;
 		size_t tile_y = (size_t)pos.y / 32;
 		tile_t* base_tile = &st.tiles[tile_x + tile_y*game_st.map_tile_width];
@@ -12413,7 +12959,7 @@ struct state_functions {
 				vision_propagation[index] = 0xff;
 				if (tile_x + cur.x >= game_st.map_tile_width) continue;
 				if (tile_y + cur.y >= game_st.map_tile_height) continue;
-				auto& tile = base_tile[cur.relative_tile_index];
+				auto& tile = base_tile[cur.y * (int)game_st.map_tile_width + cur.x];
 				tile.visible &= visibility_mask;
 				tile.explored &= visibility_mask;
 				vision_propagation[index] = (uint32_t)tile.flags << 16 | (uint32_t)tile.explored << 8 | (uint32_t)tile.visible;
@@ -12427,7 +12973,7 @@ struct state_functions {
 				if (vision_propagation[cur.prev] & required_tile_mask) {
 					if (cur.prev2 == (size_t)~0 || (vision_propagation[cur.prev2] & required_tile_mask)) continue;
 				}
-				auto& tile = base_tile[cur.relative_tile_index];
+				auto& tile = base_tile[cur.y * (int)game_st.map_tile_width + cur.x];
 				tile.visible &= visibility_mask;
 				tile.explored &= visibility_mask;
 				vision_propagation[index] = (uint32_t)tile.flags << 16 | (uint32_t)tile.explored << 8 | (uint32_t)tile.visible;
@@ -12440,7 +12986,7 @@ struct state_functions {
 			for (; cur != end; ++cur) {
 				if (tile_x + cur->x >= game_st.map_tile_width) continue;
 				if (tile_y + cur->y >= game_st.map_tile_height) continue;
-				auto& tile = base_tile[cur->relative_tile_index];
+				auto& tile = base_tile[cur->y * (int)game_st.map_tile_width + cur->x];
 				tile.visible &= visibility_mask;
 				tile.explored &= visibility_mask;
 			}
@@ -12757,7 +13303,8 @@ struct state_functions {
 		return true;
 	}
 
-	uint32_t unit_calculate_detected_flags(const unit_t* u) const {
+	template<typename for_each_nearby_detector_F>
+	uint32_t unit_calculate_detected_flags(const unit_t* u, for_each_nearby_detector_F&& for_each_nearby_detector) const {
 		if (u->defensive_matrix_hp != 0_fp8 || u->lockdown_timer || u->maelstrom_timer || u->irradiate_timer || u->ensnare_timer || u->stasis_timer || u->plague_timer || u->acid_spore_count) {
 			return 0xff;
 		} else if (visible_to_everyone(u)) {
@@ -12783,9 +13330,7 @@ struct state_functions {
 			if (!unit_target_in_range(detector, u, range)) return;
 			detected_flags |= (1 << detector->owner) | st.shared_vision[detector->owner] | detector->parasite_flags;
 		};
-		for (const unit_t* nu : find_units_noexpand(square_at(u->sprite->position, 32 * 11))) {
-			test(nu);
-		}
+		for_each_nearby_detector(detected_flags, test);
 		for (const unit_t* nu : ptr(st.map_revealer_units)) {
 			test(nu);
 		}
@@ -12793,6 +13338,94 @@ struct state_functions {
 		return detected_flags;
 	}
 
+	uint32_t unit_calculate_detected_flags(const unit_t* u) const {
+		return unit_calculate_detected_flags(u, [&](uint32_t, auto&& test) {
+			for (const unit_t* nu : find_units_noexpand(square_at(u->sprite->position, 32 * 11))) {
+				test(nu);
+			}
+		});
+	}
+
+	// The detectors in the unit finder, bucketed into cells of 256x256 pixels by the
+	// positions from which the search in unit_calculate_detected_flags can find them.
+	// flags holds what the detectors of each cell can add to detected flags at most.
+	// It is only valid while no unit moves, so update_units builds it for the detection
+	// updates it does between movement and the unit updates.
+	struct detector_cells_t {
+		size_t width = 0;
+		a_vector<uint32_t> flags;
+		a_vector<size_t> begin;
+		a_vector<size_t> end;
+		a_vector<const unit_t*> detectors;
+		a_vector<std::pair<const unit_t*, rect>> cell_areas;
+	};
+	detector_cells_t detector_cells;
+
+	void update_detector_cells() {
+		auto& c = detector_cells;
+		c.width = (game_st.map_width + 255) / 256;
+		size_t height = (game_st.map_height + 255) / 256;
+		c.cell_areas.clear();
+		for (auto& e : st.unit_finder_x) {
+			if (e.value != e.bb.from.x) continue;
+			if (!ut_detector(e.u)) continue;
+			int from_x = std::max(e.bb.from.x - 32 * 11 + 1, 0);
+			int from_y = std::max(e.bb.from.y - 32 * 11 + 1, 0);
+			int to_x = std::min(e.bb.to.x + 32 * 11, (int)game_st.map_width - 1);
+			int to_y = std::min(e.bb.to.y + 32 * 11, (int)game_st.map_height - 1);
+			if (from_x > to_x || from_y > to_y) continue;
+			c.cell_areas.push_back({e.u, {{from_x / 256, from_y / 256}, {to_x / 256, to_y / 256}}});
+		}
+		c.flags.assign(c.width * height, 0);
+		c.begin.assign(c.width * height, 0);
+		for (auto& v : c.cell_areas) {
+			const unit_t* d = v.first;
+			uint32_t flags = (1 << d->owner) | st.shared_vision[d->owner] | d->parasite_flags;
+			for (int y = v.second.from.y; y <= v.second.to.y; ++y) {
+				for (int x = v.second.from.x; x <= v.second.to.x; ++x) {
+					c.flags[y * c.width + x] |= flags;
+					++c.begin[y * c.width + x];
+				}
+			}
+		}
+		size_t n = 0;
+		for (auto& v : c.begin) {
+			n += v;
+			v = n - v;
+		}
+		c.end = c.begin;
+		c.detectors.resize(n);
+		for (auto& v : c.cell_areas) {
+			for (int y = v.second.from.y; y <= v.second.to.y; ++y) {
+				for (int x = v.second.from.x; x <= v.second.to.x; ++x) {
+					c.detectors[c.end[y * c.width + x]++] = v.first;
+				}
+			}
+		}
+	}
+
+	// unit_calculate_detected_flags, finding the detectors through detector_cells.
+	uint32_t unit_calculate_detected_flags_from_detector_cells(const unit_t* u) const {
+		xy pos = u->sprite->position;
+		if ((size_t)pos.x >= game_st.map_width || (size_t)pos.y >= game_st.map_height) return unit_calculate_detected_flags(u);
+		auto& c = detector_cells;
+		size_t index = (size_t)pos.y / 256u * c.width + (size_t)pos.x / 256u;
+		rect area = square_at(pos, 32 * 11);
+		return unit_calculate_detected_flags(u, [&](uint32_t detected_flags, auto&& test) {
+			if ((c.flags[index] & ~detected_flags) == 0) return;
+			for (size_t i = c.begin[index]; i != c.end[index]; ++i) {
+				const unit_t* d = c.detectors[i];
+				// The same test as unit_finder_search does when it is not expanded.
+				const rect& bb = d->unit_finder_bounding_box;
+				bool from_in_range = bb.from.x >= area.from.x && bb.from.x < area.to.x;
+				bool to_in_range = bb.to.x >= area.from.x && bb.to.x < area.to.x;
+				if (!from_in_range && !to_in_range) continue;
+				if (bb.from.x >= area.to.x || bb.from.y >= area.to.y || bb.to.y < area.from.y) continue;
+				test(d);
+			}
+		});
+	}
+
 	void remove_target_references(unit_t* u, const unit_t* target) {
 		auto test = [&](auto*& ref) {
 			if (ref == target) {
@@ -12836,7 +13469,10 @@ struct state_functions {
 	}
 
 	void update_unit_detected_flags(unit_t* u) {
-		uint32_t new_flags = unit_calculate_detected_flags(u);
+		set_unit_detected_flags(u, unit_calculate_detected_flags(u));
+	}
+
+	void set_unit_detected_flags(unit_t* u, uint32_t new_flags) {
 		if (u->detected_flags == new_flags) return;
 		uint32_t old_flags = u->detected_flags;
 		if (old_flags == 0x80000000) {
@@ -12856,13 +13492,14 @@ struct state_functions {
 
 	void update_psionic_matrix() {
 		st.update_psionic_matrix = false;
+		update_psionic_matrix_tiles();
 		for (unit_t* u : ptr(st.visible_units)) {
 			if (!u_grounded_building(u)) continue;
 			if (unit_race(u) != race_t::protoss) continue;
 			if (st.players[u->owner].controller == player_t::controller_rescue_passive) continue;
 			if (!ut_requires_psionic_matrix(u)) continue;
 			bool was_disabled = u_disabled(u);
-			if (is_in_psionic_matrix(u->owner, u->sprite->position)) {
+			if (psionic_matrix_tiles_has_power(u->owner, u->sprite->position)) {
 				u_unset_status_flag(u, unit_t::status_flag_disabled);
 				if (u_completed(u) && was_disabled) {
 					sprite_run_anim(u->sprite, iscript_anims::Enable);
@@ -12990,6 +13627,8 @@ struct state_functions {
 		for (unit_t* u : ptr(st.visible_units)) {
 			iscript_flingy = u;
 			iscript_unit = u;
+			// UM_Lump does nothing but ask for a vision refresh on frames that update tiles.
+			if (u->movement_state == movement_states::UM_Lump && !update_tiles && !u->subunit) continue;
 			update_unit_movement(u);
 		}
 
@@ -12999,13 +13638,18 @@ struct state_functions {
 			}
 		}
 
+		bool detector_cells_updated = false;
 		for (unit_t* u : ptr(st.visible_units)) {
 			update_unit_sprite(u);
 			if (u_cloaked(u) || u_requires_detector(u)) {
 				u->cloak_counter = 0;
 				if (u->secondary_order_timer) --u->secondary_order_timer;
 				else {
-					update_unit_detected_flags(u);
+					if (!detector_cells_updated) {
+						update_detector_cells();
+						detector_cells_updated = true;
+					}
+					set_unit_detected_flags(u, unit_calculate_detected_flags_from_detector_cells(u));
 					u->secondary_order_timer = 30;
 				}
 			}
@@ -13704,6 +14348,7 @@ struct state_functions {
 		on_unit_damage(u, source_unit, reveal_source);
 		if (damage < u->hp) {
 			u->hp -= damage;
+			wake_unit_regen(u);
 			u->air_strength = get_unit_strength(u, false);
 			u->ground_strength = get_unit_strength(u, true);
 			if (u_completed(u)) {
@@ -13720,6 +14365,7 @@ struct state_functions {
 				}
 			}
 			u->hp = 0_fp8;
+			wake_unit_regen(u);
 			kill_unit(u);
 			// todo: units lost scores
 			if (source_unit && unit_target_is_enemy(source_unit, u)) {
@@ -13789,6 +14435,7 @@ struct state_functions {
 		unit_deal_damage(target, damage, source_unit, source_owner, weapon->id != WeaponTypes::Irradiate);
 		if (shield_damage != 0_fp8) {
 			target->shield_points -= shield_damage;
+			wake_unit_regen(target);
 			if (weapon->damage_type != weapon_type_t::damage_type_none && target->shield_points != 0_fp8) {
 				create_shield_damage_effect(target, heading);
 			}
@@ -13851,11 +14498,14 @@ struct state_functions {
 		return true;
 	}
 
+	a_vector<unit_t*> air_splash_targets;
+
 	template<bool is_air_splash>
 	void bullet_deal_splash_damage(bullet_t* b) {
 		auto bb = square_at(b->sprite->position, b->weapon_type->outer_splash_radius);
 		if (is_air_splash) {
-			a_vector<unit_t*> targets;
+			auto& targets = air_splash_targets;
+			targets.clear();
 			for (unit_t* target : find_units(bb)) {
 				if (target == b->bullet_owner_unit) continue;
 				if (target->owner == b->owner && target != b->bullet_target) continue;
@@ -13977,6 +14627,7 @@ struct state_functions {
 			if (target->stasis_timer) continue;
 			target->energy = 0_fp8;
 			target->shield_points = 0_fp8;
+			wake_unit_regen(target);
 		}
 	}
 
@@ -14030,6 +14681,7 @@ struct state_functions {
 		kill_unit(target);
 		if (!u_hallucination(target)) {
 			source_unit->energy = std::min(source_unit->energy + fp8::integer(50), unit_max_energy(source_unit));
+			wake_unit_regen(source_unit);
 		}
 	}
 
@@ -14619,8 +15271,8 @@ struct state_functions {
 			st.free_thingies.pop_front();
 			return r;
 		}
-		if (st.thingies.size() >= 500) return nullptr;
-		return &*st.thingies.emplace(st.thingies.end());
+		if (st.thingies.size() >= st.thingies.max_size) return nullptr;
+		return st.thingies.emplace();
 	}
 
 	bool initialize_thingy(thingy_t* t, const sprite_type_t* sprite_type, xy pos, int owner) {
@@ -14720,6 +15372,32 @@ struct state_functions {
 			--state.wait;
 			return true;
 		}
+		if (iscript_switch_dispatch) return iscript_execute_program<false>(image, state, noop, distance_moved, allow_main_image_destruction);
+		return iscript_execute_program<true>(image, state, noop, distance_moved, allow_main_image_destruction);
+	}
+
+	// Each handler is a case of the switch and, with computed goto, also a label that
+	// the end of the previous handler jumps to directly. Handlers that break or continue
+	// go back through the top of the loop instead, which works for both.
+#ifdef BWGAME_ISCRIPT_COMPUTED_GOTO
+#define BWGAME_ISCRIPT_CASE(name) case name: label_##name
+#define BWGAME_ISCRIPT_DEFAULT default: label_unhandled
+#define BWGAME_ISCRIPT_NEXT \
+	if (threaded) { \
+		if (p == program_data) error("iscript: program counter is null"); \
+		opc = *p++; \
+		goto *dispatch_table[opc]; \
+	} \
+	break
+#else
+#define BWGAME_ISCRIPT_CASE(name) case name
+#define BWGAME_ISCRIPT_DEFAULT default
+#define BWGAME_ISCRIPT_NEXT break
+#endif
+
+	template<bool threaded>
+	bool iscript_execute_program(image_t* image, iscript_state_t& state, bool noop, fp8* distance_moved, bool allow_main_image_destruction) {
+		using namespace iscript_opcodes;
 
 		auto play_frame = [&](size_t frame_index) {
 			if (image->frame_index_base == frame_index) return;
@@ -14781,45 +15459,95 @@ struct state_functions {
 			if (weapon->bullet_count == 2) fire_weapon(iscript_unit, weapon, forward_offset);
 		};
 
-		const int* program_data = global_st.iscript.program_data.data();
-		const int* p = program_data + state.program_counter;
+		const uint8_t* program_data = global_st.iscript.program_data.data();
+		const uint8_t* p = program_data + state.program_counter;
+
+		// Operands, in the encoding of load_iscript_bin.
+		auto u8 = [&]() {
+			return (int)*p++;
+		};
+		auto s8 = [&]() {
+			return (int)(int8_t)*p++;
+		};
+		auto u16 = [&]() {
+			p += 2;
+			return (int)data_loading::value_at<uint16_t, true>(p - 2);
+		};
+		auto pc = [&]() {
+			p += 4;
+			return (size_t)data_loading::value_at<uint32_t, true>(p - 4);
+		};
 
 		auto playsndrand = [&]() {
-			int n = *p++;
+			int n = u8();
 			if (!noop) {
 				int index = lcg_rand(4) % n;
-				play_sound(p[index], image->sprite);
+				play_sound(data_loading::value_at<uint16_t, true>(p + index * 2), image->sprite);
 			}
-			p += n;
+			p += n * 2;
+		};
+
+#ifdef BWGAME_ISCRIPT_COMPUTED_GOTO
+		// Indexed by opcode. load_iscript_bin rejects any opcode past the end of it.
+		static void* const dispatch_table[] = {
+			&&label_opc_playfram, &&label_opc_playframtile, &&label_opc_sethorpos, &&label_opc_setvertpos,
+			&&label_opc_setpos, &&label_opc_wait, &&label_opc_waitrand, &&label_opc_goto,
+			&&label_opc_imgol, &&label_opc_imgul, &&label_opc_imgolorig, &&label_opc_switchul,
+			&&label_unhandled, &&label_opc_imgoluselo, &&label_unhandled, &&label_opc_sprol,
+			&&label_unhandled, &&label_opc_lowsprul, &&label_unhandled, &&label_opc_spruluselo,
+			&&label_opc_sprul, &&label_opc_sproluselo, &&label_opc_end, &&label_opc_setflipstate,
+			&&label_opc_playsnd, &&label_opc_playsndrand, &&label_opc_playsndbtwn, &&label_opc_domissiledmg,
+			&&label_opc_attackmelee, &&label_opc_followmaingraphic, &&label_opc_randcondjmp, &&label_opc_turnccwise,
+			&&label_opc_turncwise, &&label_opc_turn1cwise, &&label_opc_turnrand, &&label_unhandled,
+			&&label_opc_sigorder, &&label_opc_attackwith, &&label_opc_attack, &&label_opc_castspell,
+			&&label_opc_useweapon, &&label_opc_move, &&label_opc_gotorepeatattk, &&label_opc_engframe,
+			&&label_opc_engset, &&label_unhandled, &&label_opc_nobrkcodestart, &&label_opc_nobrkcodeend,
+			&&label_opc_ignorerest, &&label_opc_attkshiftproj, &&label_opc_tmprmgraphicstart, &&label_opc_tmprmgraphicend,
+			&&label_opc_setfldirect, &&label_opc_call, &&label_opc_return, &&label_opc_setflspeed,
+			&&label_opc_creategasoverlays, &&label_opc_pwrupcondjmp, &&label_opc_trgtrangecondjmp, &&label_opc_trgtarccondjmp,
+			&&label_opc_curdirectcondjmp, &&label_opc_imgulnextid, &&label_unhandled, &&label_opc_liftoffcondjmp,
+			&&label_opc_warpoverlay, &&label_opc_orderdone, &&label_opc_grdsprol, &&label_unhandled,
+			&&label_opc_dogrddamage
 		};
+		static_assert(std::size(dispatch_table) == opc_dogrddamage + 1, "iscript dispatch table does not cover every opcode");
+#endif
 
+		int opc;
+		int a, b, c;
 		while (true) {
-			using namespace iscript_opcodes;
-			size_t pc = p - program_data;
-			if (pc == 0) error("iscript: program counter is null");
-			int opc = *p++ - 0x808091;
-			int a, b, c;
+			if (p == program_data) error("iscript: program counter is null");
+			opc = *p++;
+#ifdef BWGAME_ISCRIPT_COMPUTED_GOTO
+			if (threaded) goto *dispatch_table[opc];
+#endif
 			switch (opc) {
-			case opc_playfram:
-				a = *p++;
-				if (noop) break;
-				play_frame(a);
-				break;
-			case opc_playframtile:
-				a = *p++;
+			BWGAME_ISCRIPT_CASE(opc_playfram):
+				a = u16();
+				if (!noop) play_frame(a);
+				// Most animations loop over playfram followed by wait, so the wait is run
+				// here rather than dispatched to.
+				if (threaded && *p == opc_wait) {
+					++p;
+					state.wait = u8() - 1;
+					state.program_counter = p - program_data;
+					return true;
+				}
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_CASE(opc_playframtile):
+				a = u16();
 				if (noop) break;
 				if ((size_t)a + game_st.tileset_index < image->grp->frames.size()) play_frame(a + game_st.tileset_index);
-				break;
-			case opc_sethorpos:
-				a = *p++;
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_CASE(opc_sethorpos):
+				a = s8();
 				if (noop) break;
 				if (image->offset.x != a) {
 					image->offset.x = a;
 					image->flags |= image_t::flag_redraw;
 				}
-				break;
-			case opc_setvertpos:
-				a = *p++;
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_CASE(opc_setvertpos):
+				a = s8();
 				if (noop) break;
 				if (!iscript_unit || (!u_requires_detector(iscript_unit) && !u_cloaked(iscript_unit))) {
 					if (image->offset.y != a) {
@@ -14827,38 +15555,38 @@ struct state_functions {
 						image->flags |= image_t::flag_redraw;
 					}
 				}
-				break;
-			case opc_setpos:
-				a = *p++;
-				b = *p++;
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_CASE(opc_setpos):
+				a = s8();
+				b = s8();
 				if (noop) break;
 				set_image_offset(image, xy(a, b));
-				break;
-			case opc_wait:
-				state.wait = *p++ - 1;
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_CASE(opc_wait):
+				state.wait = u8() - 1;
 				state.program_counter = p - program_data;
 				return true;
-			case opc_waitrand:
-				a = *p++;
-				b = *p++;
+			BWGAME_ISCRIPT_CASE(opc_waitrand):
+				a = u8();
+				b = u8();
 				if (noop) break;
 				state.wait = a + ((lcg_rand(3) & 0xff) % (b - a + 1)) - 1;
 				state.program_counter = p - program_data;
 				return true;
-			case opc_goto:
-				p = program_data + *p;
-				break;
-			case opc_imgol:
-			case opc_imgul:
-				a = *p++;
-				b = *p++;
-				c = *p++;
+			BWGAME_ISCRIPT_CASE(opc_goto):
+				p = program_data + pc();
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_CASE(opc_imgol):
+			BWGAME_ISCRIPT_CASE(opc_imgul):
+				a = u16();
+				b = u8();
+				c = u8();
 				if (noop) break;
 				add_image((ImageTypes)a, image->offset + xy(b, c), opc == opc_imgol ? image_order_above : image_order_below);
-				break;
-			case opc_imgolorig:
-			case opc_switchul:
-				a = *p++;
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_CASE(opc_imgolorig):
+			BWGAME_ISCRIPT_CASE(opc_switchul):
+				a = u16();
 				if (noop) break;
 				if (image_t* new_image = add_image((ImageTypes)a, xy(), opc == opc_imgolorig ? image_order_above : image_order_below)) {
 					if (!i_flag(new_image, image_t::flag_uses_special_offset)) {
@@ -14866,106 +15594,106 @@ struct state_functions {
 						update_image_special_offset(new_image);
 					}
 				}
-				break;
-			case opc_imgoluselo:
-				a = *p++;
-				b = *p++;
-				c = *p++;
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_CASE(opc_imgoluselo):
+				a = u16();
+				b = u8();
+				c = u8();
 				if (noop) break;
 				add_image((ImageTypes)a, get_image_lo_offset(image, (size_t)b, (size_t)c), image_order_above);
-				break;
+				BWGAME_ISCRIPT_NEXT;
 
-			case opc_sprol:
-				a = *p++;
-				b = *p++;
-				c = *p++;
+			BWGAME_ISCRIPT_CASE(opc_sprol):
+				a = u16();
+				b = s8();
+				c = s8();
 				if (noop) break;
 				if (iscript_bullet && iscript_bullet->bullet_owner_unit && unit_is_goliath(iscript_bullet->bullet_owner_unit) && player_has_upgrade(iscript_bullet->bullet_owner_unit->owner, UpgradeTypes::Charon_Boosters)) {
 					create_thingy_at_image(image, get_sprite_type(SpriteTypes::SPRITEID_Halo_Rockets_Trail), {b, c}, image->sprite->elevation_level + 1);
 				} else {
 					create_thingy_at_image(image, get_sprite_type((SpriteTypes)a), {b, c}, image->sprite->elevation_level + 1);
 				}
-				break;
+				BWGAME_ISCRIPT_NEXT;
 
-			case opc_lowsprul:
-				a = *p++;
-				b = *p++;
-				c = *p++;
+			BWGAME_ISCRIPT_CASE(opc_lowsprul):
+				a = u16();
+				b = u8();
+				c = u8();
 				if (noop) break;
 				create_thingy_at_image(image, get_sprite_type((SpriteTypes)a), {b, c}, 1);
-				break;
+				BWGAME_ISCRIPT_NEXT;
 
-			case opc_spruluselo:
-				a = *p++;
-				b = *p++;
-				c = *p++;
+			BWGAME_ISCRIPT_CASE(opc_spruluselo):
+				a = u16();
+				b = u8();
+				c = u8();
 				if (noop) break;
 				if (auto* sprite = get_sprite_type((SpriteTypes)a)) {
 					if (iscript_unit && (u_requires_detector(iscript_unit) || u_cloaked(iscript_unit)) && !sprite->image->always_visible) break;
 					auto* t = create_thingy_at_image(image, sprite, {b, c}, image->sprite->elevation_level);
 					if (t) set_sprite_images_heading_by_image_index(t->sprite, image);
 				}
-				break;
-			case opc_sprul:
-				a = *p++;
-				b = *p++;
-				c = *p++;
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_CASE(opc_sprul):
+				a = u16();
+				b = u8();
+				c = u8();
 				if (noop) break;
 				if (auto* sprite = get_sprite_type((SpriteTypes)a)) {
 					if (iscript_unit && (u_requires_detector(iscript_unit) || u_cloaked(iscript_unit)) && !sprite->image->always_visible) break;
 					auto* t = create_thingy_at_image(image, sprite, {b, c}, image->sprite->elevation_level - 1);
 					if (t) set_sprite_images_heading_by_image_index(t->sprite, image);
 				}
-				break;
-			case opc_sproluselo:
-				a = *p++;
-				b = *p++;
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_CASE(opc_sproluselo):
+				a = u16();
+				b = u8();
 				if (noop) break;
 				if (auto* sprite = get_sprite_type((SpriteTypes)a)) {
 					auto* t = create_thingy_at_image(image, sprite, get_image_lo_offset(image, (size_t)b, 0), image->sprite->elevation_level + 1);
 					if (t) set_sprite_images_heading_by_image_index(t->sprite, image);
 				}
-				break;
-			case opc_end:
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_CASE(opc_end):
 				if (noop) break;
 				if (image == image->sprite->main_image && !allow_main_image_destruction) error("iscript_execute: main image not allowed to be destroyed here");
 				state.program_counter = 0;
 				destroy_image(image);
 				return false;
-			case opc_setflipstate:
-				a = *p++;
+			BWGAME_ISCRIPT_CASE(opc_setflipstate):
+				a = u8();
 				if (noop) break;
 				if (i_flag(image, image_t::flag_horizontally_flipped) != (a != 0)) {
 					i_set_flag(image, image_t::flag_horizontally_flipped, a != 0);
 					set_image_modifier(image, image->modifier);
 					if (image->flags & image_t::flag_uses_special_offset) update_image_special_offset(image);
 				}
-				break;
-			case opc_playsnd:
-				a = *p++;
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_CASE(opc_playsnd):
+				a = u16();
 				if (noop) break;
 				play_sound(a, image->sprite);
-				break;
-			case opc_playsndrand:
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_CASE(opc_playsndrand):
 				playsndrand();
-				break;
-			case opc_playsndbtwn:
-				a = *p++;
-				b = *p++;
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_CASE(opc_playsndbtwn):
+				a = u16();
+				b = u16();
 				if (noop) break;
 					play_sound(a + lcg_rand(5) % (b - a + 1), image->sprite);
-				break;
-			case opc_domissiledmg:
-			case opc_dogrddamage:
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_CASE(opc_domissiledmg):
+			BWGAME_ISCRIPT_CASE(opc_dogrddamage):
 				if (noop) break;
 				if (iscript_bullet) bullet_hit(iscript_bullet);
-				break;
-			case opc_attackmelee:
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_CASE(opc_attackmelee):
 				if (!noop && iscript_unit) melee_deal_damage(iscript_unit);
 				playsndrand();
-				break;
+				BWGAME_ISCRIPT_NEXT;
 
-			case opc_followmaingraphic:
+			BWGAME_ISCRIPT_CASE(opc_followmaingraphic):
 				if (noop) break;
 				if (image_t* main_image = image->sprite->main_image) {
 					auto frame_index = main_image->frame_index;
@@ -14975,103 +15703,103 @@ struct state_functions {
 						set_image_frame_index_offset(image, main_image->frame_index_offset, flipped);
 					}
 				}
-				break;
-			case opc_randcondjmp:
-				a = *p++;
-				b = *p++;
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_CASE(opc_randcondjmp):
+				a = u8();
+				b = (int)pc();
 				if ((lcg_rand(7) & 0xff) <= a) {
 					p = program_data + b;
 				}
-				break;
+				BWGAME_ISCRIPT_NEXT;
 
-			case opc_turnccwise:
-				a = *p++;
+			BWGAME_ISCRIPT_CASE(opc_turnccwise):
+				a = u8();
 				if (noop) break;
 				if (iscript_unit) set_unit_heading(iscript_unit, iscript_unit->heading - 8_dir * a);
-				break;
-			case opc_turncwise:
-				a = *p++;
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_CASE(opc_turncwise):
+				a = u8();
 				if (noop) break;
 				if (iscript_unit) set_unit_heading(iscript_unit, iscript_unit->heading + 8_dir * a);
-				break;
-			case opc_turn1cwise:
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_CASE(opc_turn1cwise):
 				if (noop) break;
 				if (iscript_unit && !iscript_unit->order_target.unit) set_unit_heading(iscript_unit, iscript_unit->heading + 8_dir);
-				break;
-			case opc_turnrand:
-				a = *p++;
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_CASE(opc_turnrand):
+				a = u8();
 				if (noop) break;
 				if (lcg_rand(6) % 4 == 1) {
 					if (iscript_unit) set_unit_heading(iscript_unit, iscript_unit->heading - 8_dir * a);
 				} else {
 					if (iscript_unit) set_unit_heading(iscript_unit, iscript_unit->heading + 8_dir * a);
 				}
-				break;
+				BWGAME_ISCRIPT_NEXT;
 
-			case opc_sigorder:
-				a = *p++;
+			BWGAME_ISCRIPT_CASE(opc_sigorder):
+				a = u8();
 				if (noop) break;
 				if (iscript_flingy) iscript_flingy->order_signal |= a;
-				break;
-			case opc_attackwith:
-				a = *p++;
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_CASE(opc_attackwith):
+				a = u8();
 				if (noop) break;
 				if (iscript_unit) attack_with(a);
-				break;
-			case opc_attack:
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_CASE(opc_attack):
 				if (noop) break;
 				if (iscript_unit && iscript_unit->order_target.unit) {
 					if (!u_flying(iscript_unit->order_target.unit)) {
 						attack_with(1);
 					} else attack_with(2);
 				}
-				break;
-			case opc_castspell:
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_CASE(opc_castspell):
 				if (noop) break;
 				if (iscript_unit && iscript_unit->order_type->weapon != WeaponTypes::None) {
 					if (spell_order_valid(iscript_unit)) {
 						attack_with_weapon(get_weapon_type(iscript_unit->order_type->weapon));
 					}
 				}
-				break;
-			case opc_useweapon:
-				a = *p++;
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_CASE(opc_useweapon):
+				a = u8();
 				if (noop) break;
 				if (iscript_unit) use_weapon(iscript_unit, (WeaponTypes)a);
-				break;
-			case opc_move:
-				a = *p++;
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_CASE(opc_move):
+				a = u8();
 				if (distance_moved) {
 					if (iscript_unit) *distance_moved = get_modified_unit_speed(iscript_unit, fp8::integer(a));
 				}
 				if (noop) break;
 				if (iscript_unit) set_next_speed(iscript_unit, get_modified_unit_speed(iscript_unit, fp8::integer(a)));
-				break;
-			case opc_gotorepeatattk:
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_CASE(opc_gotorepeatattk):
 				if (noop) break;
 				if (iscript_unit) u_unset_movement_flag(iscript_unit, 8);
-				break;
-			case opc_engframe:
-				a = *p++;
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_CASE(opc_engframe):
+				a = u8();
 				if (noop) break;
 				image->frame_index_base = a;
 				set_image_frame_index_offset(image, image->sprite->main_image->frame_index_offset, i_flag(image->sprite->main_image, image_t::flag_horizontally_flipped));
-				break;
-			case opc_engset:
-				a = *p++;
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_CASE(opc_engset):
+				a = u8();
 				if (noop) break;
 				image->frame_index_base = image->sprite->main_image->frame_index_base + (image->sprite->main_image->grp->frames.size() & 0x7fff) * a;
 				set_image_frame_index_offset(image, image->sprite->main_image->frame_index_offset, i_flag(image->sprite->main_image, image_t::flag_horizontally_flipped));
-				break;
+				BWGAME_ISCRIPT_NEXT;
 
-			case opc_nobrkcodestart:
+			BWGAME_ISCRIPT_CASE(opc_nobrkcodestart):
 				if (noop) break;
 				if (iscript_unit) {
 					u_set_status_flag(iscript_unit, unit_t::status_flag_iscript_nobrk);
 					iscript_unit->sprite->flags |= sprite_t::flag_iscript_nobrk;
 				}
-				break;
-			case opc_nobrkcodeend:
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_CASE(opc_nobrkcodeend):
 				if (noop) break;
 				if (iscript_unit) {
 					u_unset_status_flag(iscript_unit, unit_t::status_flag_iscript_nobrk);
@@ -15081,8 +15809,8 @@ struct state_functions {
 						activate_next_order(iscript_unit);
 					}
 				}
-				break;
-			case opc_ignorerest:
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_CASE(opc_ignorerest):
 				if (noop) break;
 				if (iscript_unit && !iscript_unit->order_target.unit) {
 					iscript_run_to_idle(iscript_unit);
@@ -15091,59 +15819,59 @@ struct state_functions {
 				state.wait = 10;
 				state.program_counter = p - 1 - program_data;
 				return true;
-			case opc_attkshiftproj:
-				a = *p++;
+			BWGAME_ISCRIPT_CASE(opc_attkshiftproj):
+				a = u8();
 				if (noop) break;
 				if (iscript_unit) attack_with_forward_offset(1, a);
-				break;
-			case opc_tmprmgraphicstart:
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_CASE(opc_tmprmgraphicstart):
 				if (noop) break;
 				hide_image(image);
-				break;
-			case opc_tmprmgraphicend:
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_CASE(opc_tmprmgraphicend):
 				if (noop) break;
 				show_image(image);
-				break;
+				BWGAME_ISCRIPT_NEXT;
 
-			case opc_setfldirect:
-				a = *p++;
+			BWGAME_ISCRIPT_CASE(opc_setfldirect):
+				a = u8();
 				if (noop) break;
 				if (iscript_unit) set_unit_heading(iscript_unit, 8_dir * a);
-				break;
+				BWGAME_ISCRIPT_NEXT;
 
-			case opc_setflspeed:
-				a = *p++;
+			BWGAME_ISCRIPT_CASE(opc_setflspeed):
+				a = u16();
 				if (noop) break;
 				if (iscript_unit) iscript_unit->flingy_top_speed = fp8::from_raw(a);
-				break;
+				BWGAME_ISCRIPT_NEXT;
 
-			case opc_call:
-				a = *p++;
+			BWGAME_ISCRIPT_CASE(opc_call):
+				a = (int)pc();
 				state.return_address = p - program_data;
 				p = program_data + a;
-				break;
-			case opc_return:
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_CASE(opc_return):
 				p = program_data + state.return_address;
-				break;
+				BWGAME_ISCRIPT_NEXT;
 
-			case opc_creategasoverlays:
-				a = *p++;
+			BWGAME_ISCRIPT_CASE(opc_creategasoverlays):
+				a = u8();
 				if (noop) break;
 				if (iscript_unit && ut_resource(iscript_unit)) {
 					ImageTypes image_id = iscript_unit->building.resource.resource_count ? ImageTypes::IMAGEID_Vespene_Geyser_Smoke1 : ImageTypes::IMAGEID_Vespene_Geyser_Smoke1_Overlay;
 					image_id = (ImageTypes)((size_t)image_id + a);
 					create_image(get_image_type(image_id), image->sprite, image->offset + get_image_lo_offset(image, 2, a), image_order_above);
 				}
-				break;
-			case opc_pwrupcondjmp:
-				a = *p++;
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_CASE(opc_pwrupcondjmp):
+				a = (int)pc();
 				if (image->sprite && image->sprite->main_image != image) {
 					p = program_data + a;
 				}
-				break;
-			case opc_trgtrangecondjmp:
-				a = *p++;
-				b = *p++;
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_CASE(opc_trgtrangecondjmp):
+				a = u16();
+				b = (int)pc();
 				if (noop) continue;
 				if (iscript_unit && iscript_unit->order_target.unit) {
 					xy pos = get_bullet_appear_at_target_pos(iscript_unit, iscript_unit->order_target.unit);
@@ -15151,68 +15879,72 @@ struct state_functions {
 						p = program_data + b;
 					}
 				}
-				break;
-			case opc_trgtarccondjmp:
-				a = *p++;
-				b = *p++;
-				c = *p++;
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_CASE(opc_trgtarccondjmp):
+				a = u16();
+				b = u16();
+				c = (int)pc();
 				if (noop) break;
 				if (iscript_unit && iscript_unit->order_target.unit) {
 					if (fp8::extend(direction_t::from_raw(a) - xy_direction(iscript_unit->order_target.unit->sprite->position - iscript_unit->sprite->position)).abs() < fp8::from_raw(b)) {
 						p = program_data + c;
 					}
 				}
-				break;
-			case opc_curdirectcondjmp:
-				a = *p++;
-				b = *p++;
-				c = *p++;
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_CASE(opc_curdirectcondjmp):
+				a = u16();
+				b = u16();
+				c = (int)pc();
 				if (noop) break;
 				if (iscript_unit && fp8::extend(iscript_unit->heading - direction_t::from_raw(a)).abs() < fp8::from_raw(b)) {
 					p = program_data + c;
 				}
-				break;
-			case opc_imgulnextid:
-				a = *p++;
-				b = *p++;
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_CASE(opc_imgulnextid):
+				a = u8();
+				b = u8();
 				if (noop) break;
 				add_image((ImageTypes)((int)image->image_type->id + 1), image->offset + xy(a, b), image_order_below);
-				break;
+				BWGAME_ISCRIPT_NEXT;
 
-			case opc_liftoffcondjmp:
-				a = *p++;
+			BWGAME_ISCRIPT_CASE(opc_liftoffcondjmp):
+				a = (int)pc();
 				if (noop) break;
 				if (iscript_unit && u_flying(iscript_unit)) {
 					p = program_data + a;
 				}
-				break;
-			case opc_warpoverlay:
-				a = *p++;
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_CASE(opc_warpoverlay):
+				a = u16();
 				if (noop) break;
 				image->modifier_data1 = a & 0xff;
 				image->modifier_data2 = (a >> 8) & 0xff;
-				break;
-			case opc_orderdone:
-				a = *p++;
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_CASE(opc_orderdone):
+				a = u8();
 				if (noop) break;
 				if (iscript_flingy) iscript_flingy->order_signal &= ~a;
-				break;
-			case opc_grdsprol:
-				a = *p++;
-				b = *p++;
-				c = *p++;
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_CASE(opc_grdsprol):
+				a = u16();
+				b = u8();
+				c = u8();
 				if (noop) break;
 				if (unit_type_can_fit_at(get_unit_type(UnitTypes::Terran_Marine), image->sprite->position + image->offset + xy(b, c))) {
 					create_thingy_at_image(image, get_sprite_type((SpriteTypes)a), xy(b, c), image->sprite->elevation_level + 1);
 				}
-				break;
-			default:
+				BWGAME_ISCRIPT_NEXT;
+			BWGAME_ISCRIPT_DEFAULT:
 				error("iscript: unhandled opcode %d", opc);
 			}
 		}
 
 	}
 
+#undef BWGAME_ISCRIPT_CASE
+#undef BWGAME_ISCRIPT_DEFAULT
+#undef BWGAME_ISCRIPT_NEXT
+
 	bool iscript_run_anim(image_t* image, int new_anim) {
 		using namespace iscript_anims;
 		int old_anim = image->iscript_state.animation;
@@ -15601,9 +16333,9 @@ struct state_functions {
 				return a.value < b;
 			};
 			auto from_i = std::lower_bound(vec.begin(), vec.end(), from_value, cmp_l);
-			vec.insert(from_i, {u, from_value});
+			vec.insert(from_i, {u, from_value, bb});
 			auto to_i = std::lower_bound(vec.begin(), vec.end(), to_value, cmp_l);
-			vec.insert(to_i, {u, to_value});
+			vec.insert(to_i, {u, to_value, bb});
 		};
 		insert(st.unit_finder_x, bb.from.x, bb.to.x);
 		insert(st.unit_finder_y, bb.from.y, bb.to.y);
@@ -15612,11 +16344,16 @@ struct state_functions {
 	void unit_finder_reinsert(unit_t* u, rect bb) {
 		if (unit_finder_search_index) error("attempt to modify unit finder while search is active");
 		auto reinsert = [&](auto& vec, int old_value, int new_value) {
-			if (old_value == new_value) return;
 			auto cmp_l = [&](auto& a, int b) {
 				return a.value < b;
 			};
 			auto i = std::lower_bound(vec.begin(), vec.end(), old_value, cmp_l);
+			if (old_value == new_value) {
+				for (; i != vec.end() && i->value == old_value; ++i) {
+					if (i->u == u) i->bb = bb;
+				}
+				return;
+			}
 			while (i->u != u) ++i;
 			if (new_value > old_value) {
 				auto ni = std::next(i);
@@ -15625,7 +16362,7 @@ struct state_functions {
 					++i;
 					++ni;
 				}
-				*i = {u, new_value};
+				*i = {u, new_value, bb};
 			} else {
 				while (i != vec.begin()) {
 					auto ni = i;
@@ -15636,7 +16373,7 @@ struct state_functions {
 					}
 					*ni = *i;
 				}
-				*i = {u, new_value};
+				*i = {u, new_value, bb};
 			}
 		};
 		if (bb.from.x <= u->unit_finder_bounding_box.from.x) {
@@ -15669,10 +16406,9 @@ struct state_functions {
 			friend unit_finder_search;
 			iterator(const unit_finder_search* search, a_vector<state::unit_finder_entry>::iterator i) : search(search), i(i) {}
 			bool in_bounds() {
-				unit_t* u = i->u;
-				if (u->unit_finder_bounding_box.from.x >= search->area.to.x) return false;
-				if (u->unit_finder_bounding_box.from.y >= search->area.to.y) return false;
-				if (u->unit_finder_bounding_box.to.y < search->area.from.y) return false;
+				if (i->bb.from.x >= search->area.to.x) return false;
+				if (i->bb.from.y >= search->area.to.y) return false;
+				if (i->bb.to.y < search->area.from.y) return false;
 				return true;
 			}
 		public:
@@ -15821,7 +16557,7 @@ struct state_functions {
 	}
 
 	bool image_has_data_at(const image_t* image, xy pos) const {
-		auto& frame = image->grp->frames.at(image->frame_index);
+		auto& frame = grp_frame(*image->grp, image->frame_index);
 		xy map_pos = get_image_map_position(image);
 		int x = pos.x - map_pos.x;
 		if (i_flag(image, image_t::flag_horizontally_flipped)) x = image->grp->width - 2 * frame.offset.x - x;
@@ -15829,7 +16565,7 @@ struct state_functions {
 		if ((size_t)x >= frame.size.x) return false;
 		if ((size_t)y >= frame.size.y) return false;
 
-		const uint8_t* d = frame.data_container.data() + frame.line_data_offset.at(y);
+		const uint8_t* d = frame.line_data(y);
 		while (x > 0) {
 			int v = *d++;
 			if (v & 0x80) {
@@ -16069,6 +16805,7 @@ struct state_functions {
 		u->shield_points = fp8::integer(u->unit_type->shield_points);
 		if (unit_is(u, UnitTypes::Protoss_Shield_Battery)) u->energy = fp8::integer(100);
 		else u->energy = unit_max_energy(u) / 4;
+		wake_unit_regen(u);
 
 		u->sprite->elevation_level = unit_type->elevation_level;
 		u_set_status_flag(u, unit_t::status_flag_grounded_building, ut_building(u));
@@ -16180,6 +16917,7 @@ struct state_functions {
 		if (u->unit_type->has_shield && u_grounded_building(u)) {
 			fp8 max_shields = fp8::integer(u->unit_type->shield_points);
 			u->shield_points = max_shields / 10;
+			wake_unit_regen(u);
 			if (u->unit_type->build_time == 0) {
 				u->shield_construction_rate = fp8::integer(1);
 			} else {
@@ -16342,6 +17080,7 @@ struct state_functions {
 				u->order_state = 0;
 				u->order_unit_type = nullptr;
 				u->hp = u->unit_type->hitpoints;
+				wake_unit_regen(u);
 				set_unit_owner(u, 11, false);
 				set_sprite_owner(u, 11);
 				u_set_status_flag(u, unit_t::status_flag_completed);
@@ -16455,6 +17194,7 @@ struct state_functions {
 		u->acid_spore_count = 0;
 		u->acid_spore_time = {};
 		u->status_flags = 0;
+		u->regen_idle = false;
 		u->user_action_flags = 0;
 		u->pathing_flags = 0;
 		u->previous_hp = 1;
@@ -16666,6 +17406,7 @@ struct state_functions {
 		if (u->remaining_build_time) {
 			u->hp = u->unit_type->hitpoints;
 			u->shield_points = fp8::integer(u->unit_type->shield_points);
+			wake_unit_regen(u);
 			u->remaining_build_time = 0;
 		}
 		if (u_grounded_building(u)) {
@@ -16911,6 +17652,7 @@ struct state_functions {
 			add_completed_unit(turret, 1, false);
 			u_set_status_flag(turret, unit_t::status_flag_completed);
 			turret->hp = turret->unit_type->hitpoints;
+			wake_unit_regen(turret);
 			move_unit(turret, pos);
 		}
 		return true;
@@ -19745,13 +20487,15 @@ struct state_copier {
 	const state& st;
 	state& r;
 	state_functions funcs;
-	state_copier(const state&st, state& r) : st(st), r(r), funcs(r) {}
+	state_copier(const state&st, state& r) : st(st), r(r), funcs(r) {
+		set_state_limits(r, get_state_limits(st));
+	}
 
-	std::array<bool, 1700> unit_copied{};
-	std::array<bool, 100> bullet_copied{};
-	std::array<bool, 2500> sprite_copied{};
-	std::array<bool, 5000> image_copied{};
-	std::array<bool, 2000> order_copied{};
+	a_vector<bool> unit_copied = a_vector<bool>(st.units_container.max_size);
+	a_vector<bool> bullet_copied = a_vector<bool>(st.bullets_container.max_size);
+	a_vector<bool> sprite_copied = a_vector<bool>(st.sprites_container.max_size);
+	a_vector<bool> image_copied = a_vector<bool>(st.images_container.max_size);
+	a_vector<bool> order_copied = a_vector<bool>(st.orders_container.max_size);
 	unit_t* unit(const unit_t* v) {
 		size_t index = v->index;
 		auto* u = r.units_container.get(index, false);
@@ -19878,8 +20622,8 @@ struct state_copier {
 		if (!v) return nullptr;
 		auto*& rv = path_remap[v];
 		if (!rv) {
-			r.paths.emplace_back(*v);
-			rv = &r.paths.back();
+			rv = r.paths.emplace(*v);
+			reserve_path_buffers(*rv);
 		}
 		return rv;
 	}
@@ -19888,8 +20632,7 @@ struct state_copier {
 		if (!v) return nullptr;
 		auto*& rv = thingy_remap[v];
 		if (!rv) {
-			r.thingies.emplace_back(*v);
-			rv = &r.thingies.back();
+			rv = r.thingies.emplace(*v);
 			remap_sprite(rv->sprite);
 		}
 		return rv;
@@ -20120,8 +20863,6 @@ struct game_load_functions : state_functions {
 
 		calculate_unit_strengths();
 
-		generate_sight_values();
-
 		load_tile_stuff();
 
 		st.tiles.clear();
@@ -20145,20 +20886,20 @@ struct game_load_functions : state_functions {
 		st.dead_units.clear();
 		for (auto& v : st.player_units) v.clear();
 
-		st.units_container = {};
+		st.units_container.clear();
 
 		st.active_bullets_size = 0;
 		st.active_bullets.clear();
-		st.bullets_container = {};
+		st.bullets_container.clear();
 
-		st.sprites_container = {};
+		st.sprites_container.clear();
 		st.sprites_on_tile_line.clear();
 		st.sprites_on_tile_line.resize(game_st.map_tile_height);
 
-		st.images_container = {};
+		st.images_container.clear();
 
 		st.active_orders_size = 0;
-		st.orders_container = {};
+		st.orders_container.clear();
 
 		st.active_thingies_size = 0;
 		st.active_thingies.clear();
@@ -20228,45 +20969,57 @@ struct game_load_functions : state_functions {
 	void regions_create() {
 
 		a_vector<uint8_t> unwalkable_flags(256 * 4 * 256 * 4);
+		// The 0x80 bit of unwalkable_flags, packed into 64-bit words, so that several walk
+		// tiles can be tested at a time.
+		const size_t row_words = 256 * 4 / 64;
+		a_vector<uint64_t> unwalkable_bits(256 * 4 * row_words);
 
-		auto is_unwalkable = [&](size_t walk_x, size_t walk_y) {
-			return unwalkable_flags[walk_y * 256 * 4 + walk_x] & 0x80 ? true : false;
-		};
 		auto is_walkable = [&](size_t walk_x, size_t walk_y) {
 			return ~unwalkable_flags[walk_y * 256 * 4 + walk_x] & 0x80 ? true : false;
 		};
-		auto set_unwalkable = [&](size_t walk_x, size_t walk_y) {
-			unwalkable_flags[walk_y * 256 * 4 + walk_x] |= 0x80;
-		};
 		auto is_dir_walkable = [&](size_t walk_x, size_t walk_y, size_t dir) {
 			return ~unwalkable_flags[walk_y * 256 * 4 + walk_x] & (1 << dir) ? true : false;
 		};
 		auto is_dir_unwalkable = [&](size_t walk_x, size_t walk_y, size_t dir) {
 			return unwalkable_flags[walk_y * 256 * 4 + walk_x] & (1 << dir) ? true : false;
 		};
-		auto set_dir_unwalkable = [&](size_t walk_x, size_t walk_y, size_t dir) {
-			unwalkable_flags[walk_y * 256 * 4 + walk_x] |= 1 << dir;
-		};
 		auto flip_dir_walkable = [&](size_t walk_x, size_t walk_y, size_t dir) {
 			unwalkable_flags[walk_y * 256 * 4 + walk_x] ^= 1 << dir;
 		};
 		auto is_every_dir_walkable = [&](size_t walk_x, size_t walk_y) {
 			return unwalkable_flags[walk_y * 256 * 4 + walk_x] & 0x7f ? false : true;
 		};
+		// is_every_dir_walkable for the 4 walk tiles starting at walk_x, tested in one go.
+		auto is_every_dir_walkable_x4 = [&](size_t walk_x, size_t walk_y) {
+			uint32_t v;
+			memcpy(&v, &unwalkable_flags[walk_y * 256 * 4 + walk_x], 4);
+			return v & 0x7f7f7f7f ? false : true;
+		};
+		// walk_x must be even, so that both columns are in the same word.
+		auto is_2x2_walkable = [&](size_t walk_x, size_t walk_y) {
+			size_t i = walk_y * row_words + walk_x / 64;
+			return (unwalkable_bits[i] | unwalkable_bits[i + row_words]) >> (walk_x % 64) & 3 ? false : true;
+		};
 
 		auto set_unwalkable_flags = [&]() {
 
+			// Walkability is collected in unwalkable_bits first, so that the direction flags
+			// can be computed for 64 walk tiles at a time below.
+			auto set_unwalkable_bit = [&](size_t walk_x, size_t walk_y) {
+				unwalkable_bits[walk_y * row_words + walk_x / 64] |= (uint64_t)1 << (walk_x % 64);
+			};
+
 			for (size_t y = 0; y != game_st.map_tile_height; ++y) {
 				for (size_t x = 0; x != game_st.map_tile_width; ++x) {
 					uint16_t mega_tile_index = st.tiles_mega_tile_index[y * game_st.map_tile_width + x];
 
 					auto& mt = game_st.vf4[mega_tile_index & 0x7fff];
 					for (size_t sy = 0; sy < 4; ++sy) {
+						uint64_t bits = 0;
 						for (size_t sx = 0; sx < 4; ++sx) {
-							if (~mt.flags[sy * 4 + sx] & vf4_entry::flag_walkable) {
-								set_unwalkable(x * 4 + sx, y * 4 + sy);
-							}
+							if (~mt.flags[sy * 4 + sx] & vf4_entry::flag_walkable) bits |= 1 << sx;
 						}
+						unwalkable_bits[(y * 4 + sy) * row_words + x / 16] |= bits << (x % 16 * 4);
 					}
 				}
 			}
@@ -20274,16 +21027,16 @@ struct game_load_functions : state_functions {
 			if (game_st.map_walk_height >= 8) {
 				for (size_t y = game_st.map_walk_height - 8; y != game_st.map_walk_height; ++y) {
 					for (size_t x = 0; x != 20; ++x) {
-						set_unwalkable(x, y);
+						set_unwalkable_bit(x, y);
 					}
 					if (game_st.map_walk_width >= 20) {
 						for (size_t x = game_st.map_walk_width - 20; x != game_st.map_walk_width; ++x) {
-							set_unwalkable(x, y);
+							set_unwalkable_bit(x, y);
 						}
 					}
 					if (y >= game_st.map_walk_height - 4) {
 						for (size_t x = 0; x != game_st.map_walk_width; ++x) {
-							set_unwalkable(x, y);
+							set_unwalkable_bit(x, y);
 						}
 					}
 				}
@@ -20291,13 +21044,47 @@ struct game_load_functions : state_functions {
 
 			if (game_st.map_walk_width == 0 || game_st.map_walk_height == 0) error("map width/height is zero");
 
+			// spread[v] has byte i set to bit i of v, so that 8 walk tiles worth of flags can be
+			// assembled at a time.
+			static const std::array<uint64_t, 256> spread = []() {
+				std::array<uint64_t, 256> r;
+				for (size_t v = 0; v != 256; ++v) {
+					std::array<uint8_t, 8> bytes;
+					for (size_t i = 0; i != 8; ++i) bytes[i] = v >> i & 1;
+					memcpy(&r[v], bytes.data(), 8);
+				}
+				return r;
+			}();
+
+			// Each bit of up/right/down/left is set if the corresponding neighbor is unwalkable
+			// or outside the map.
+			size_t last_word = (game_st.map_walk_width - 1) / 64;
+			uint64_t last_word_mask = ~(uint64_t)0 >> (63 - (game_st.map_walk_width - 1) % 64);
 			for (size_t y = 0; y != game_st.map_walk_height; ++y) {
-				for (size_t x = 0; x != game_st.map_walk_width; ++x) {
-					if (is_unwalkable(x, y)) continue;
-					if (y == 0 || is_unwalkable(x, y - 1)) set_dir_unwalkable(x, y, 0);
-					if (x == game_st.map_walk_width - 1 || is_unwalkable(x + 1, y)) set_dir_unwalkable(x, y, 1);
-					if (y == game_st.map_walk_height - 1 || is_unwalkable(x, y + 1)) set_dir_unwalkable(x, y, 2);
-					if (x == 0 || is_unwalkable(x - 1, y)) set_dir_unwalkable(x, y, 3);
+				const uint64_t* row = &unwalkable_bits[y * row_words];
+				for (size_t w = 0; w <= last_word; ++w) {
+					uint64_t unwalkable = row[w];
+					uint64_t up = y == 0 ? ~(uint64_t)0 : row[w - row_words];
+					uint64_t down = y == game_st.map_walk_height - 1 ? ~(uint64_t)0 : row[w + row_words];
+					uint64_t right = unwalkable >> 1 | (w + 1 != row_words ? row[w + 1] << 63 : 0);
+					uint64_t left = unwalkable << 1 | (w ? row[w - 1] >> 63 : 1);
+					if (w == last_word) {
+						right |= last_word_mask ^ last_word_mask >> 1;
+						up &= last_word_mask;
+						right &= last_word_mask;
+						down &= last_word_mask;
+						left &= last_word_mask;
+					}
+					if (!(unwalkable | up | right | down | left)) continue;
+					// unwalkable is not masked; the UI area is marked from x 0 to 20 even on maps
+					// narrower than that.
+					uint8_t* flags = &unwalkable_flags[y * 256 * 4 + w * 64];
+					for (size_t i = 0; i != 64; i += 8) {
+						uint64_t dirs = spread[up >> i & 0xff] | spread[right >> i & 0xff] << 1 | spread[down >> i & 0xff] << 2 | spread[left >> i & 0xff] << 3;
+						uint64_t u = spread[unwalkable >> i & 0xff];
+						uint64_t v = u << 7 | (dirs & ~(u * 0xff));
+						memcpy(flags + i, &v, 8);
+					}
 				}
 			}
 		};
@@ -20340,27 +21127,37 @@ struct game_load_functions : state_functions {
 
 			auto bb = game_st.regions.tile_bounding_box;
 
+			// The number of tiles not yet in a region, in total and for each row, so that
+			// find_empty_region can skip over rows that are already done.
+			size_t empty_tiles = 0;
+			a_vector<size_t> row_empty_tiles(bb.to.y);
+			for (size_t y = bb.from.y; y != bb.to.y; ++y) {
+				for (size_t x = bb.from.x; x != bb.to.x; ++x) {
+					if (game_st.regions.tile_region_index[y * 256 + x] >= 5000) ++row_empty_tiles[y];
+				}
+				empty_tiles += row_empty_tiles[y];
+			}
+
 			auto find_empty_region = [&](size_t x, size_t y) {
 				if (x >= bb.to.x) {
 					x = bb.from.x;
 					y = y + 1 >= bb.to.y ? bb.from.y : y + 1;
 				}
-				size_t start_x = x;
-				size_t start_y = y;
+				if (empty_tiles == 0) return false;
 				while (true) {
-					size_t index = game_st.regions.tile_region_index[y * 256 + x];
-					if (index >= 5000) {
-						region_tile_index = index;
-						region_x = x;
-						region_y = y;
-						return true;
-					}
-					++x;
-					if (x >= bb.to.x) {
-						x = bb.from.x;
-						y = y + 1 >= bb.to.y ? bb.from.y : y + 1;
+					if (row_empty_tiles[y]) {
+						for (; x != bb.to.x; ++x) {
+							size_t index = game_st.regions.tile_region_index[y * 256 + x];
+							if (index >= 5000) {
+								region_tile_index = index;
+								region_x = x;
+								region_y = y;
+								return true;
+							}
+						}
 					}
-					if (x == start_x && y == start_y) return false;
+					x = bb.from.x;
+					y = y + 1 >= bb.to.y ? bb.from.y : y + 1;
 				}
 
 			};
@@ -20462,8 +21259,12 @@ struct game_load_functions : state_functions {
 					if (game_st.regions.regions.size() >= 5000) error("too many regions (nooks and crannies)");
 
 					auto* r = create_region(area);
+					for (size_t y = area.from.y; y != area.to.y; ++y) {
+						row_empty_tiles[y] -= area.to.x - area.from.x;
+					}
+					empty_tiles -= size;
 
-					auto expand = [this](regions_t ::region* r) {
+					auto expand = [&](regions_t ::region* r) {
 
 						size_t& begin_x = r->tile_area.from.x;
 						if (begin_x > 0) --begin_x;
@@ -20490,6 +21291,8 @@ struct game_load_functions : state_functions {
 								for (size_t x = begin_x; x != end_x; ++x) {
 									if (game_st.regions.tile_region_index[y * 256 + x] == flags && is_neighbor(x, y)) {
 										game_st.regions.tile_region_index[y * 256 + x] = index;
+										--row_empty_tiles[y];
+										--empty_tiles;
 									}
 								}
 							}
@@ -20556,11 +21359,18 @@ struct game_load_functions : state_functions {
 					if (r->tile_count == 0) r->flags = 0x1fff;
 				}
 
+				// added_to[i] is the index + 1 of the last region that region i was added to as a
+				// neighbor, so the neighbor lists need not be searched for duplicates.
+				a_vector<size_t> added_to(game_st.regions.regions.size());
+				// The lists are collected here first, so each region's lists are allocated only once.
+				a_vector<regions_t::region*> walkable_neighbors;
+				a_vector<regions_t::region*> non_walkable_neighbors;
+
 				for (auto* r : ptr(game_st.regions.regions)) {
 					if (r->tile_count == 0) continue;
 
-					r->walkable_neighbors.clear();
-					r->non_walkable_neighbors.clear();
+					walkable_neighbors.clear();
+					non_walkable_neighbors.clear();
 
 					for (int y = r->area.from.y / 32; y != r->area.to.y / 32; ++y) {
 						for (int x = r->area.from.x / 32; x != r->area.to.x / 32; ++x) {
@@ -20569,20 +21379,12 @@ struct game_load_functions : state_functions {
 							for (size_t i = 0; i != 8; ++i) {
 								size_t nindex = neighbors[i];
 								if (nindex == 0x1fff || nindex == r->index) continue;
+								if (added_to[nindex] == r->index + 1) continue;
 								auto* nr = &game_st.regions.regions[nindex];
 								bool add = false;
 								if (i < 4 || !r->walkable() || !nr->walkable()) {
 									add = true;
 								} else {
-									auto is_2x2_walkable = [&](size_t walk_x, size_t walk_y) {
-										if (!is_walkable(walk_x, walk_y)) return false;
-										if (!is_walkable(walk_x + 1, walk_y)) return false;
-										if (!is_walkable(walk_x, walk_y + 1)) return false;
-										if (!is_walkable(walk_x + 1, walk_y + 1)) return false;
-										return true;
-									};
-
-
 									size_t walk_x = x * 4;
 									size_t walk_y = y * 4;
 									if (i == 4) {
@@ -20608,19 +21410,15 @@ struct game_load_functions : state_functions {
 									}
 								}
 								if (add) {
-									if (nr->walkable()) {
-										if (std::find(r->walkable_neighbors.begin(), r->walkable_neighbors.end(), nr) == r->walkable_neighbors.end()) {
-											r->walkable_neighbors.push_back(nr);
-										}
-									} else {
-										if (std::find(r->non_walkable_neighbors.begin(), r->non_walkable_neighbors.end(), nr) == r->non_walkable_neighbors.end()) {
-											r->non_walkable_neighbors.push_back(nr);
-										}
-									}
+									added_to[nindex] = r->index + 1;
+									if (nr->walkable()) walkable_neighbors.push_back(nr);
+									else non_walkable_neighbors.push_back(nr);
 								}
 							}
 						}
 					}
+					r->walkable_neighbors.assign(walkable_neighbors.begin(), walkable_neighbors.end());
+					r->non_walkable_neighbors.assign(non_walkable_neighbors.begin(), non_walkable_neighbors.end());
 
 					if (!r->non_walkable_neighbors.empty()) {
 						for (auto& v : r->non_walkable_neighbors) {
@@ -20877,7 +21675,7 @@ struct game_load_functions : state_functions {
 				x = x / 4 * 4;
 				size_t start_x = x;
 				size_t start_y = y;
-				while (is_every_dir_walkable(x, y) && is_every_dir_walkable(x + 1, y) && is_every_dir_walkable(x + 2, y) && is_every_dir_walkable(x + 3, y)) {
+				while (is_every_dir_walkable_x4(x, y)) {
 					x += 4;
 					if (x == game_st.map_walk_width) {
 						x = 0;
@@ -21018,6 +21816,169 @@ struct game_load_functions : state_functions {
 
 	}
 
+	// Identifies everything regions_create reads: the map dimensions and, for every
+	// tile, its flags, megatile index and the megatile's walkability.
+	uint64_t regions_cache_key() const {
+		a_vector<uint8_t> data;
+		auto put = [&](auto v) {
+			size_t n = data.size();
+			data.resize(n + sizeof(v));
+			memcpy(data.data() + n, &v, sizeof(v));
+		};
+		put((uint32_t)game_st.map_tile_width);
+		put((uint32_t)game_st.map_tile_height);
+		for (size_t i = 0; i != game_st.map_tile_width * game_st.map_tile_height; ++i) {
+			uint16_t mega_tile_index = st.tiles_mega_tile_index[i];
+			put(st.tiles[i].flags);
+			put(mega_tile_index);
+			if ((size_t)(mega_tile_index & 0x7fff) < game_st.vf4.size()) {
+				for (auto v : game_st.vf4[mega_tile_index & 0x7fff].flags) put(v);
+			}
+		}
+		return data_loading::hash_bytes(data.data(), data.size());
+	}
+
+	static const uint32_t regions_cache_identifier = 0x434e4752; // 'RGNC'
+	static const uint32_t regions_cache_version = 1;
+
+	template<typename writer_T>
+	void save_regions(writer_T& w, uint64_t key) const {
+		auto& regions = game_st.regions;
+		w.template put<uint32_t>(regions_cache_identifier);
+		w.template put<uint32_t>(regions_cache_version);
+		w.template put<uint64_t>(key);
+		for (auto v : regions.tile_region_index) w.template put<uint32_t>((uint32_t)v);
+		w.template put<uint32_t>((uint32_t)regions.tile_bounding_box.from.x);
+		w.template put<uint32_t>((uint32_t)regions.tile_bounding_box.from.y);
+		w.template put<uint32_t>((uint32_t)regions.tile_bounding_box.to.x);
+		w.template put<uint32_t>((uint32_t)regions.tile_bounding_box.to.y);
+		auto put_region_index = [&](const regions_t::region* r) {
+			w.template put<uint32_t>((uint32_t)(r - regions.regions.data()));
+		};
+		w.template put<uint32_t>((uint32_t)regions.regions.size());
+		for (auto& r : regions.regions) {
+			w.template put<uint16_t>(r.flags);
+			w.template put<uint32_t>((uint32_t)r.index);
+			w.template put<uint32_t>((uint32_t)r.tile_center.x);
+			w.template put<uint32_t>((uint32_t)r.tile_center.y);
+			w.template put<uint32_t>((uint32_t)r.tile_area.from.x);
+			w.template put<uint32_t>((uint32_t)r.tile_area.from.y);
+			w.template put<uint32_t>((uint32_t)r.tile_area.to.x);
+			w.template put<uint32_t>((uint32_t)r.tile_area.to.y);
+			w.template put<int32_t>(r.center.x.raw_value);
+			w.template put<int32_t>(r.center.y.raw_value);
+			w.template put<int32_t>(r.area.from.x);
+			w.template put<int32_t>(r.area.from.y);
+			w.template put<int32_t>(r.area.to.x);
+			w.template put<int32_t>(r.area.to.y);
+			w.template put<uint32_t>((uint32_t)r.tile_count);
+			w.template put<uint32_t>((uint32_t)r.group_index);
+			w.template put<uint32_t>((uint32_t)r.walkable_neighbors.size());
+			for (auto* n : r.walkable_neighbors) put_region_index(n);
+			w.template put<uint32_t>((uint32_t)r.non_walkable_neighbors.size());
+			for (auto* n : r.non_walkable_neighbors) put_region_index(n);
+		}
+		w.template put<uint32_t>((uint32_t)regions.split_regions.size());
+		for (auto& v : regions.split_regions) {
+			w.template put<uint16_t>(v.mask);
+			put_region_index(v.a);
+			put_region_index(v.b);
+		}
+		for (auto& c : regions.contours) {
+			w.template put<uint32_t>((uint32_t)c.size());
+			for (auto& v : c) {
+				for (int n : v.v) w.template put<int32_t>(n);
+				w.template put<uint8_t>((uint8_t)v.dir);
+				w.template put<uint8_t>(v.flags);
+			}
+		}
+	}
+
+	// Returns false, leaving game_st.regions untouched, if the data was not written by
+	// save_regions with the same key.
+	bool load_regions(data_loading::data_reader_le r, uint64_t key) {
+		if (r.left() < 16) return false;
+		if (r.get<uint32_t>() != regions_cache_identifier) return false;
+		if (r.get<uint32_t>() != regions_cache_version) return false;
+		if (r.get<uint64_t>() != key) return false;
+		regions_t regions;
+		for (auto& v : regions.tile_region_index) v = r.get<uint32_t>();
+		regions.tile_bounding_box.from.x = r.get<uint32_t>();
+		regions.tile_bounding_box.from.y = r.get<uint32_t>();
+		regions.tile_bounding_box.to.x = r.get<uint32_t>();
+		regions.tile_bounding_box.to.y = r.get<uint32_t>();
+		size_t region_count = r.get<uint32_t>();
+		if (region_count > 5000) error("load_regions: too many regions");
+		regions.regions.resize(region_count);
+		auto get_region = [&]() {
+			size_t index = r.get<uint32_t>();
+			if (index >= regions.regions.size()) error("load_regions: invalid region index");
+			return &regions.regions[index];
+		};
+		for (auto& v : regions.regions) {
+			v.flags = r.get<uint16_t>();
+			v.index = r.get<uint32_t>();
+			v.tile_center.x = r.get<uint32_t>();
+			v.tile_center.y = r.get<uint32_t>();
+			v.tile_area.from.x = r.get<uint32_t>();
+			v.tile_area.from.y = r.get<uint32_t>();
+			v.tile_area.to.x = r.get<uint32_t>();
+			v.tile_area.to.y = r.get<uint32_t>();
+			v.center.x = fp8::from_raw(r.get<int32_t>());
+			v.center.y = fp8::from_raw(r.get<int32_t>());
+			v.area.from.x = r.get<int32_t>();
+			v.area.from.y = r.get<int32_t>();
+			v.area.to.x = r.get<int32_t>();
+			v.area.to.y = r.get<int32_t>();
+			v.tile_count = r.get<uint32_t>();
+			v.group_index = r.get<uint32_t>();
+			v.walkable_neighbors.resize(r.get<uint32_t>());
+			for (auto& n : v.walkable_neighbors) n = get_region();
+			v.non_walkable_neighbors.resize(r.get<uint32_t>());
+			for (auto& n : v.non_walkable_neighbors) n = get_region();
+		}
+		regions.split_regions.resize(r.get<uint32_t>());
+		for (auto& v : regions.split_regions) {
+			v.mask = r.get<uint16_t>();
+			v.a = get_region();
+			v.b = get_region();
+		}
+		for (auto& c : regions.contours) {
+			c.resize(r.get<uint32_t>());
+			for (auto& v : c) {
+				for (int& n : v.v) n = r.get<int32_t>();
+				v.dir = r.get<uint8_t>();
+				v.flags = r.get<uint8_t>();
+			}
+		}
+		if (r.left()) error("load_regions: trailing data");
+		game_st.regions = std::move(regions);
+		return true;
+	}
+
+	// regions_create, going through the cache in global_st.regions_cache_path if it is set.
+	// An unreadable or stale cache file is rebuilt; failing to write it is not an error.
+	void load_or_create_regions() {
+		if (global_st.regions_cache_path.empty()) {
+			regions_create();
+			return;
+		}
+		uint64_t key = regions_cache_key();
+		a_string filename = format("%s/%016x.regions", global_st.regions_cache_path, key);
+		try {
+			data_loading::mapped_file f(filename);
+			if (load_regions(data_loading::data_reader_le(f.data(), f.data() + f.size()), key)) return;
+		} catch (const std::exception&) {
+		}
+		regions_create();
+		try {
+			data_loading::replace_file(filename, [&](data_loading::file_writer<>& w) {
+				save_regions(w, key);
+			});
+		} catch (const std::exception&) {
+		}
+	}
+
 	int get_unit_strength(const unit_type_t* unit_type, const weapon_type_t* weapon_type) {
 		switch (unit_type->id) {
 		case UnitTypes::Terran_Vulture_Spider_Mine:
@@ -21102,174 +22063,6 @@ struct game_load_functions : state_functions {
 
 	}
 
-	void generate_sight_values() {
-		for (size_t i = 0; i != game_st.sight_values.size(); ++i) {
-			auto& v = game_st.sight_values[i];
-			v.max_width = 3 + (int)i * 2;
-			v.max_height = 3 + (int)i * 2;
-			v.min_width = 3;
-			v.min_height = 3;
-			v.min_mask_size = 0;
-			v.ext_masked_count = 0;
-		}
-
-		struct base_mask_t {
-			sight_values_t::maskdat_node_t* maskdat_node;
-			bool masked;
-		};
-		a_vector<base_mask_t> base_mask;
-		for (auto& v : game_st.sight_values) {
-			base_mask.clear();
-			base_mask.resize(v.max_width*v.max_height);
-			auto mask = [&](size_t index) {
-				if (index >= base_mask.size()) error("attempt to mask invalid base mask index %d (size %d)", index, base_mask.size());
-				base_mask[index].masked = true;
-			};
-			v.min_mask_size = v.min_width*v.min_height;
-			int offx = v.max_width / 2 - v.min_width / 2;
-			int offy = v.max_height / 2 - v.min_height / 2;
-			for (int y = 0; y < v.min_height; ++y) {
-				for (int x = 0; x < v.min_width; ++x) {
-					mask((offy + y)*v.max_width + offx + x);
-				}
-			}
-			auto generate_base_mask = [&]() {
-				int offset = v.max_height / 2 - v.max_width / 2;
-				int half_width = v.max_width / 2;
-				int max_x2 = half_width;
-				int max_x1 = half_width * 2;
-				int cur_x1 = 0;
-				int cur_x2 = half_width;
-				int i = 0;
-				int max_i = half_width;
-				int cursize1 = 0;
-				int cursize2 = half_width*half_width;
-				int min_cursize2 = half_width * (half_width - 1);
-				int min_cursize2_chg = half_width * 2;
-				while (true) {
-					if (cur_x1 <= max_x1) {
-						for (int i = 0; i <= max_x1 - cur_x1; ++i) {
-							mask((offset + cur_x2)*v.max_width + cur_x1 + i);
-							mask((offset + max_x2)*v.max_width + cur_x1 + i);
-						}
-					}
-					if (cur_x2 <= max_x2) {
-						for (int i = 0; i <= max_x2 - cur_x2; ++i) {
-							mask((offset + cur_x1)*v.max_width + cur_x2 + i);
-							mask((offset + max_x1)*v.max_width + cur_x2 + i);
-						}
-					}
-					cursize2 += 1 - cursize1 - 2;
-					cursize1 += 2;
-					--cur_x2;
-					++max_x2;
-					if (cursize2 <= min_cursize2) {
-						--max_i;
-						++cur_x1;
-						--max_x1;
-						min_cursize2 -= min_cursize2_chg - 2;
-						min_cursize2_chg -= 2;
-					}
-
-					++i;
-					if (i > max_i) break;
-				}
-			};
-			generate_base_mask();
-			int masked_count = 0;
-			for (auto& v : base_mask) {
-				if (v.masked) ++masked_count;
-			}
-
-			v.ext_masked_count = masked_count - v.min_mask_size;
-			v.maskdat.clear();
-			v.maskdat.resize(masked_count);
-
-			size_t center_index = v.max_height / 2 * v.max_width + v.max_width / 2;
-			base_mask[center_index].maskdat_node = &v.maskdat.front();
-
-			auto at = [&](int relative_index) -> base_mask_t& {
-				size_t index = center_index + relative_index;
-				if (index >= base_mask.size()) error("attempt to access invalid base mask center-relative index %d (size %d)", index, base_mask.size());
-				return base_mask[index];
-			};
-
-			size_t next_entry_index = 1;
-
-			int cur_x = -1;
-			int cur_y = -1;
-			int added_count = 1;
-			for (int i = 2; added_count < masked_count; i += 2) {
-				for (int dir = 0; dir < 4; ++dir) {
-					static const std::array<int, 4> direction_x = {1, 0, -1, 0};
-					static const std::array<int, 4> direction_y = {0, 1, 0, -1};
-					int this_x;
-					int this_y;
-					auto do_n = [&](int n) {
-						for (int i = 0; i < n; ++i) {
-							if (at(this_y*v.max_width + this_x).masked) {
-								if (this_x || this_y) {
-									auto* this_entry = &v.maskdat.at(next_entry_index++);
-
-									auto index = [&](auto* n) {
-										if (!n) return (size_t)-1;
-										return (size_t)(n - v.maskdat.data());
-									};
-
-									int prev_x = this_x;
-									int prev_y = this_y;
-									if (prev_x > 0) --prev_x;
-									else if (prev_x < 0) ++prev_x;
-									if (prev_y > 0) --prev_y;
-									else if (prev_y < 0) ++prev_y;
-									if (std::abs(prev_x) == std::abs(prev_y) || (this_x == 0 && direction_x[dir]) || (this_y == 0 && direction_y[dir])) {
-										this_entry->prev = index(at(prev_y * v.max_width + prev_x).maskdat_node);
-										this_entry->prev2 = (size_t)-1;
-									} else {
-										this_entry->prev = index(at(prev_y * v.max_width + prev_x).maskdat_node);
-										int prev2_x = prev_x;
-										int prev2_y = prev_y;
-										if (std::abs(prev2_x) <= std::abs(prev2_y)) {
-											if (this_x >= 0) ++prev2_x;
-											else --prev2_x;
-										} else {
-											if (this_y >= 0) ++prev2_y;
-											else --prev2_y;
-										}
-										this_entry->prev2 = index(at(prev2_y * v.max_width + prev2_x).maskdat_node);
-									}
-									this_entry->relative_tile_index = this_y * (int)game_st.map_tile_width + this_x;
-									this_entry->x = this_x;
-									this_entry->y = this_y;
-									at(this_y * v.max_width + this_x).maskdat_node = this_entry;
-									++added_count;
-								}
-							}
-							this_x += direction_x[dir];
-							this_y += direction_y[dir];
-						}
-					};
-					const std::array<int, 4> max_i = { v.max_height,v.max_width,v.max_height,v.max_width };
-					if (i > max_i[dir]) {
-						this_x = cur_x + i * direction_x[dir];
-						this_y = cur_y + i * direction_y[dir];
-						do_n(1);
-					} else {
-						this_x = cur_x + direction_x[dir];
-						this_y = cur_y + direction_y[dir];
-						do_n(std::min(max_i[(dir + 1) % 4] - 1, i));
-					}
-					cur_x = this_x - direction_x[dir];
-					cur_y = this_y - direction_y[dir];
-				}
-				if (i < v.max_width - 1) --cur_x;
-				if (i < v.max_height - 1) --cur_y;
-			}
-
-		}
-
-	}
-
 	void load_tile_stuff() {
 
 		auto set_mega_tile_flags = [&]() {
@@ -21389,8 +22182,13 @@ struct game_load_functions : state_functions {
 	a_string get_map_string(size_t index) const {
 		if (index == 0) return "<null string>";
 		--index;
-		if (index >= game_st.map_strings.size()) return "<invalid string index>";
-		const a_string& str = game_st.map_strings[index];
+		auto& data = game_st.map_string_data;
+		if (data.size() < 2) return "<invalid string index>";
+		size_t num = data_loading::value_at<uint16_t, true>(data.data());
+		if (index >= num) return "<invalid string index>";
+		size_t offset = data_loading::value_at<uint16_t, true>(data.data() + 2 + index * 2);
+		if (offset >= data.size()) return "<invalid string offset>";
+		a_string str((const char*)data.data() + offset);
 		a_string kn;
 		if (korean::korean_locale_to_utf8(str, kn)) return kn;
 		return str;
@@ -21420,7 +22218,7 @@ struct game_load_functions : state_functions {
 		load_map_data(data.data(), data.size(), std::move(setup_f), initial_processing);
 	}
 
-	void load_map_data(uint8_t* data, size_t data_size, std::function<void()> setup_f = {}, bool initial_processing = true) {
+	void load_map_data(const uint8_t* data, size_t data_size, std::function<void()> setup_f = {}, bool initial_processing = true) {
 
 		using data_loading::data_reader_le;
 
@@ -21430,10 +22228,11 @@ struct game_load_functions : state_functions {
 			return a_string(tag.data.data(), 4);
 		};
 
-		using tag_list_t = a_vector<std::pair<tag_t, bool>>;
-		auto read_chunks = [&](const tag_list_t&tags) {
+		// The sections are indexed once, and each section is only decoded when read_chunks
+		// asks for it; the readers point into data, nothing is copied.
+		a_unordered_map<tag_t, a_vector<data_reader_le>, tag_t> chunks;
+		{
 			data_reader_le r(data, data + data_size);
-			a_unordered_map<tag_t, a_vector<data_reader_le>, tag_t> chunks;
 			while (r.left()) {
 				tag_t tag = r.get<std::array<char, 4>>();
 				uint32_t len = r.get<uint32_t>();
@@ -21442,6 +22241,10 @@ struct game_load_functions : state_functions {
 				r.skip(len);
 				chunks[tag].emplace_back(chunk_data, r.ptr);
 			}
+		}
+
+		using tag_list_t = a_vector<std::pair<tag_t, bool>>;
+		auto read_chunks = [&](const tag_list_t&tags) {
 			for (auto& v : tags) {
 				tag_t tag = std::get<0>(v);
 				auto i = chunks.find(tag);
@@ -21485,20 +22288,24 @@ struct game_load_functions : state_functions {
 			if (r.left() < 2) return;
 			auto start = r;
 			size_t num = r.get<uint16_t>();
-			game_st.map_strings.clear();
-			game_st.map_strings.resize(num);
+			auto offsets = r.get_view<uint16_t>(num);
+			// Every string must be null terminated within the section, which holds if there is
+			// a null at or after the highest valid offset.
+			size_t max_offset = 0;
+			bool any_valid = false;
 			for (size_t i = 0; i != num; ++i) {
-				size_t offset = r.get<uint16_t>();
-				auto t = start;
-				if (offset < t.left()) {
-					t.skip(offset);
-					char* b = (char*)t.ptr;
-					while (t.get<char>());
-					game_st.map_strings[i] = a_string(b, (char*)t.ptr - b - 1);
-				} else {
-					game_st.map_strings[i] = "<invalid string offset>";
+				size_t offset = offsets[i];
+				if (offset < start.size()) {
+					any_valid = true;
+					max_offset = std::max(max_offset, offset);
 				}
 			}
+			if (any_valid) {
+				size_t last_null = start.size();
+				while (last_null && start.begin[last_null - 1]) --last_null;
+				if (last_null == 0 || last_null - 1 < max_offset) error("data_reader: attempt to read past end");
+			}
+			game_st.map_string_data.assign(start.begin, start.end);
 		};
 		tag_funcs["SPRP"] = [&](data_reader_le r) {
 			game_st.scenario_name = get_map_string(r.get<uint16_t>());
@@ -21560,7 +22367,7 @@ struct game_load_functions : state_functions {
 			tiles_flags_and(0, game_st.map_tile_height - 1, game_st.map_tile_width, 1, ~(tile_t::flag_walkable | tile_t::flag_has_creep | tile_t::flag_partially_walkable));
 			tiles_flags_or(0, game_st.map_tile_height - 1, game_st.map_tile_width, 1, tile_t::flag_unbuildable);
 
-			regions_create();
+			load_or_create_regions();
 		};
 
 		bool use_map_settings = false;
@@ -21592,7 +22399,7 @@ struct game_load_functions : state_functions {
 			}
 		};
 		tag_funcs["MASK"] = [&](data_reader_le r) {
-			auto mask = r.get_vec<uint8_t>(std::min(game_st.map_tile_width*game_st.map_tile_height, r.left()));
+			auto mask = r.get_view<uint8_t>(std::min(game_st.map_tile_width*game_st.map_tile_height, r.left()));
 			for (size_t i = 0; i != mask.size(); ++i) {
 				st.tiles[i].visible = mask[i];
 				st.tiles[i].explored = mask[i];
@@ -21600,16 +22407,16 @@ struct game_load_functions : state_functions {
 		};
 
 		auto units = [&](data_reader_le r, bool broodwar) {
-			auto uses_default_settings = r.get_vec<uint8_t>(228);
-			auto hp = r.get_vec<uint32_t>(228);
-			auto shield_points = r.get_vec<uint16_t>(228);
-			auto armor = r.get_vec<uint8_t>(228);
-			auto build_time = r.get_vec<uint16_t>(228);
-			auto mineral_cost = r.get_vec<uint16_t>(228);
-			auto gas_cost = r.get_vec<uint16_t>(228);
-			auto string_index = r.get_vec<uint16_t>(228);
-			auto weapon_damage = r.get_vec<uint16_t>(broodwar ? 130 : 100);
-			auto weapon_bonus_damage = r.get_vec<uint16_t>(broodwar ? 130 : 100);
+			auto uses_default_settings = r.get_view<uint8_t>(228);
+			auto hp = r.get_view<uint32_t>(228);
+			auto shield_points = r.get_view<uint16_t>(228);
+			auto armor = r.get_view<uint8_t>(228);
+			auto build_time = r.get_view<uint16_t>(228);
+			auto mineral_cost = r.get_view<uint16_t>(228);
+			auto gas_cost = r.get_view<uint16_t>(228);
+			auto string_index = r.get_view<uint16_t>(228);
+			auto weapon_damage = r.get_view<uint16_t>(broodwar ? 130 : 100);
+			auto weapon_bonus_damage = r.get_view<uint16_t>(broodwar ? 130 : 100);
 			for (size_t i = 0; i != 228; ++i) {
 				if (uses_default_settings[i]) continue;
 				unit_type_t* unit_type = get_unit_type((UnitTypes)i);
@@ -21635,14 +22442,14 @@ struct game_load_functions : state_functions {
 		};
 
 		auto upgrades = [&](data_reader_le r, bool broodwar) {
-			auto uses_default_settings = r.get_vec<uint8_t>(broodwar ? 61 : 46);
+			auto uses_default_settings = r.get_view<uint8_t>(broodwar ? 61 : 46);
 			if (broodwar) r.get<uint8_t>();
-			auto mineral_cost = r.get_vec<uint16_t>(broodwar ? 61 : 46);
-			auto mineral_cost_factor = r.get_vec<uint16_t>(broodwar ? 61 : 46);
-			auto gas_cost = r.get_vec<uint16_t>(broodwar ? 61 : 46);
-			auto gas_cost_factor = r.get_vec<uint16_t>(broodwar ? 61 : 46);
-			auto time_cost = r.get_vec<uint16_t>(broodwar ? 61 : 46);
-			auto time_cost_factor = r.get_vec<uint16_t>(broodwar ? 61 : 46);
+			auto mineral_cost = r.get_view<uint16_t>(broodwar ? 61 : 46);
+			auto mineral_cost_factor = r.get_view<uint16_t>(broodwar ? 61 : 46);
+			auto gas_cost = r.get_view<uint16_t>(broodwar ? 61 : 46);
+			auto gas_cost_factor = r.get_view<uint16_t>(broodwar ? 61 : 46);
+			auto time_cost = r.get_view<uint16_t>(broodwar ? 61 : 46);
+			auto time_cost_factor = r.get_view<uint16_t>(broodwar ? 61 : 46);
 			for (size_t i = 0; i != (broodwar ? 61 : 46); ++i) {
 				if (uses_default_settings[i]) continue;
 				upgrade_type_t* upg = get_upgrade_type((UpgradeTypes)i);
@@ -21656,11 +22463,11 @@ struct game_load_functions : state_functions {
 		};
 
 		auto techdata = [&](data_reader_le r, bool broodwar) {
-			auto uses_default_settings = r.get_vec<uint8_t>(broodwar ? 44 : 24);
-			auto mineral_cost = r.get_vec<uint16_t>(broodwar ? 44 : 24);
-			auto gas_cost = r.get_vec<uint16_t>(broodwar ? 44 : 24);
-			auto build_time = r.get_vec<uint16_t>(broodwar ? 44 : 24);
-			auto energy_cost = r.get_vec<uint16_t>(broodwar ? 44 : 24);
+			auto uses_default_settings = r.get_view<uint8_t>(broodwar ? 44 : 24);
+			auto mineral_cost = r.get_view<uint16_t>(broodwar ? 44 : 24);
+			auto gas_cost = r.get_view<uint16_t>(broodwar ? 44 : 24);
+			auto build_time = r.get_view<uint16_t>(broodwar ? 44 : 24);
+			auto energy_cost = r.get_view<uint16_t>(broodwar ? 44 : 24);
 			for (size_t i = 0; i != (broodwar ? 44 : 24); ++i) {
 				if (uses_default_settings[i]) continue;
 				tech_type_t* tech = get_tech_type((TechTypes)i);
@@ -21673,11 +22480,11 @@ struct game_load_functions : state_functions {
 
 		auto upgrade_restrictions = [&](data_reader_le r, bool broodwar) {
 			size_t count = broodwar ? 61 : 46;
-			auto player_max_level = r.get_vec<uint8_t>(12 * count);
-			auto player_cur_level = r.get_vec<uint8_t>(12 * count);
-			auto global_max_level = r.get_vec<uint8_t>(count);
-			auto global_cur_level = r.get_vec<uint8_t>(count);
-			auto player_uses_global_default = r.get_vec<uint8_t>(12 * count);
+			auto player_max_level = r.get_view<uint8_t>(12 * count);
+			auto player_cur_level = r.get_view<uint8_t>(12 * count);
+			auto global_max_level = r.get_view<uint8_t>(count);
+			auto global_cur_level = r.get_view<uint8_t>(count);
+			auto player_uses_global_default = r.get_view<uint8_t>(12 * count);
 			for (size_t player = 0; player != 12; ++player) {
 				for (size_t upgrade = 0; upgrade != count; ++upgrade) {
 					game_st.max_upgrade_levels[player][(UpgradeTypes)upgrade] = !!player_uses_global_default[player*count + upgrade] ? global_max_level[upgrade] : player_max_level[player*count + upgrade];
@@ -21687,11 +22494,11 @@ struct game_load_functions : state_functions {
 		};
 		auto tech_restrictions = [&](data_reader_le r, bool broodwar) {
 			size_t count = broodwar ? 44 : 24;
-			auto player_available = r.get_vec<uint8_t>(12 * count);
-			auto player_researched = r.get_vec<uint8_t>(12 * count);
-			auto global_available = r.get_vec<uint8_t>(count);
-			auto global_researched = r.get_vec<uint8_t>(count);
-			auto player_uses_global_default = r.get_vec<uint8_t>(12 * count);
+			auto player_available = r.get_view<uint8_t>(12 * count);
+			auto player_researched = r.get_view<uint8_t>(12 * count);
+			auto global_available = r.get_view<uint8_t>(count);
+			auto global_researched = r.get_view<uint8_t>(count);
+			auto player_uses_global_default = r.get_view<uint8_t>(12 * count);
 			for (size_t player = 0; player != 12; ++player) {
 				for (size_t tech = 0; tech != count; ++tech) {
 					game_st.tech_available[player][(TechTypes)tech] = !!(!!player_uses_global_default[player*count + tech] ? global_available[tech] : player_available[player*count + tech]);
@@ -21714,12 +22521,12 @@ struct game_load_functions : state_functions {
 		};
 		tag_funcs["PUNI"] = [&](data_reader_le r) {
 			if (!use_map_settings) error("wrong game mode");
-			auto player_available = r.get_vec<std::array<uint8_t, 228>>(12);
-			auto global_available = r.get_vec<uint8_t>(228);
-			auto player_uses_global_default = r.get_vec<std::array<uint8_t, 228>>(12);
+			auto player_available = r.get_view<uint8_t>(12 * 228);
+			auto global_available = r.get_view<uint8_t>(228);
+			auto player_uses_global_default = r.get_view<uint8_t>(12 * 228);
 			for (size_t player = 0; player != 12; ++player) {
 				for (size_t unit = 0; unit != 228; ++unit) {
-					game_st.unit_type_allowed[player][(UnitTypes)unit] = !!(!!player_uses_global_default[player][unit] ? global_available[unit] : player_available[player][unit]);
+					game_st.unit_type_allowed[player][(UnitTypes)unit] = !!(!!player_uses_global_default[player * 228 + unit] ? global_available[unit] : player_available[player * 228 + unit]);
 				}
 			}
 		};
@@ -22102,56 +22909,6 @@ struct game_load_functions : state_functions {
 	}
 };
 
-template<typename reader_T>
-grp_t read_grp(reader_T&& r) {
-	auto base_r = r;
-	grp_t grp;
-	size_t frame_count = r.template get<uint16_t>();
-	grp.width = r.template get<uint16_t>();
-	grp.height = r.template get<uint16_t>();
-	grp.frames.resize(frame_count);
-	for (size_t i = 0; i != frame_count; ++i) {
-		auto& f = grp.frames[i];
-		f.offset.x = r.template get<uint8_t>();
-		f.offset.y = r.template get<uint8_t>();
-		f.size.x = r.template get<uint8_t>();
-		f.size.y = r.template get<uint8_t>();
-		size_t file_offset = r.template get<uint32_t>();
-		auto line_offset_r = base_r;
-		line_offset_r.skip(file_offset);
-		f.line_data_offset.reserve(f.size.y);
-		for (size_t y = 0; y != f.size.y; ++y) {
-			auto line_r = base_r;
-			line_r.skip(file_offset + line_offset_r.template get<uint16_t>());
-			f.line_data_offset.push_back(f.data_container.size());
-			for (size_t x = 0; x != f.size.x;) {
-				auto v = line_r.template get<uint8_t>();
-				if (v & 0x80) {
-					v &= 0x7f;
-					if (v > f.size.x - x) v = (uint8_t)(f.size.x - x);
-					f.data_container.push_back(0x80 | v);
-					x += v;
-				} else if (v & 0x40) {
-					v &= 0x3f;
-					if (v > f.size.x - x) v = (uint8_t)(f.size.x - x);
-					f.data_container.push_back(0x40 | v);
-					f.data_container.push_back(line_r.template get<uint8_t>());
-					x += v;
-				} else {
-					if (v > f.size.x - x) v = (uint8_t)(f.size.x - x);
-					f.data_container.push_back(v);
-					for (size_t i = 0; i != v; ++i) {
-						f.data_container.push_back(line_r.template get<uint8_t>());
-					}
-					x += v;
-				}
-			}
-		}
-		f.data_container.shrink_to_fit();
-	}
-	return grp;
-}
-
 struct string_table_data {
 	a_vector<uint8_t> data;
 	a_string operator[](size_t index) const {
@@ -22168,8 +22925,19 @@ struct string_table_data {
 	}
 };
 
+// With a thread pool, independent data files are loaded and decoded concurrently
+// and load_data_file must be safe to call from several threads at once (see
+// data_loading::concurrent_data_files_directory). The resulting global_state is the
+// same either way.
 template<typename load_data_file_F>
-void global_init(global_state& st, load_data_file_F&& load_data_file) {
+void global_init(global_state& st, load_data_file_F&& load_data_file, thread_pool* pool = nullptr) {
+
+	auto parallel_for = [&](size_t n, auto&& f) {
+		if (pool) pool->parallel_for(n, f);
+		else {
+			for (size_t i = 0; i != n; ++i) f(i);
+		}
+	};
 
 	auto get_sprite_type = [&](SpriteTypes id) {
 		if ((size_t)id >= 517) error("invalid sprite id %d", (size_t)id);
@@ -22256,10 +23024,18 @@ void global_init(global_state& st, load_data_file_F&& load_data_file) {
 		ins_data[opc_dogrddamage] = "";
 
 		a_unordered_map<int, a_vector<size_t>> animation_pc;
-		a_vector<int> program_data;
+		a_vector<uint8_t> program_data;
 
 		program_data.push_back(0); // invalid/null pc
 
+		auto put = [&](auto v) {
+			for (size_t i = 0; i != sizeof(v); ++i) program_data.push_back((uint8_t)((std::make_unsigned_t<decltype(v)>)v >> (8 * i)));
+		};
+		auto put_pc = [&](size_t index, size_t pc) {
+			if ((size_t)(uint32_t)pc != pc) error("iscript too big");
+			for (size_t i = 0; i != 4; ++i) program_data[index + i] = (uint8_t)(pc >> (8 * i));
+		};
+
 		using data_loading::data_reader_le;
 
 		a_vector<uint8_t> data;
@@ -22295,30 +23071,30 @@ void global_init(global_state& st, load_data_file_F&& load_data_file) {
 					while (!done) {
 						size_t pc = program_data.size();
 						size_t cur_address = r.ptr - base_r.ptr;
-						if ((size_t)(int)pc != pc || (size_t)(int)cur_address != cur_address) error("iscript too big");
+						if ((size_t)(uint32_t)pc != pc) error("iscript too big");
 						if (cur_address != initial_address) {
 							auto in = decode_map.emplace(cur_address, pc);
 							if (!in.second) {
-								program_data.push_back(opc_goto + 0x808091);
-								program_data.push_back((int)in.first->second);
+								put((uint8_t)opc_goto);
+								put((uint32_t)in.first->second);
 								break;
 							}
 						}
 						int opcode = r.get<uint8_t>();
 						if ((size_t)opcode >= ins_data.size()) error("iscript load: at 0x%04x: invalid instruction %d", cur_address, opcode);
-						program_data.push_back(opcode + 0x808091);
+						put((uint8_t)opcode);
 						const char* c = ins_data[opcode];
 						while (*c) {
 							if (*c == 's') {
 								++c;
-								if (*c=='1') program_data.push_back(r.get<int8_t>());
-								else if (*c == '2') program_data.push_back(r.get<int16_t>());
-							} else if (*c == '1') program_data.push_back(r.get<uint8_t>());
-							else if (*c == '2') program_data.push_back(r.get<uint16_t>());
+								if (*c=='1') put(r.get<int8_t>());
+								else if (*c == '2') put(r.get<int16_t>());
+							} else if (*c == '1') put(r.get<uint8_t>());
+							else if (*c == '2') put(r.get<uint16_t>());
 							else if (*c == 'v') {
 								int n = r.get<uint8_t>();
-								program_data.push_back(n);
-								for (; n; --n) program_data.push_back(r.get<uint16_t>());
+								put((uint8_t)n);
+								for (; n; --n) put(r.get<uint16_t>());
 							} else if (*c == 'j') {
 								size_t jump_address = r.get<uint16_t>();
 								auto jump_pc_it = decode_map.find(jump_address);
@@ -22327,13 +23103,13 @@ void global_init(global_state& st, load_data_file_F&& load_data_file) {
 									r = base_r;
 									r.skip(jump_address);
 								} else {
-									program_data.push_back((int)jump_pc_it->second);
+									put((uint32_t)jump_pc_it->second);
 									done = true;
 								}
 							} else if (*c == 'b') {
 								size_t branch_address = r.get<uint16_t>();
 								branches.emplace_back(branch_address, program_data.size());
-								program_data.push_back(0);
+								put((uint32_t)0);
 							} else if (*c == 'e') {
 								done = true;
 							}
@@ -22346,9 +23122,7 @@ void global_init(global_state& st, load_data_file_F&& load_data_file) {
 				while (!branches.empty()) {
 					auto v = branches.front();
 					branches.pop_front();
-					size_t pc = decode(std::get<0>(v));
-					if ((size_t)(int)pc != pc) error("iscript load: 0x%x does not fit in an int", pc);
-					program_data[std::get<1>(v)] = (int)pc;
+					put_pc(std::get<1>(v), decode(std::get<0>(v)));
 				}
 				return initial_pc;
 			};
@@ -22390,18 +23164,9 @@ void global_init(global_state& st, load_data_file_F&& load_data_file) {
 		size_t file_count = r.get<uint16_t>();
 		(void)file_count;
 
-		a_vector<grp_t> grps;
-		a_vector<a_vector<a_vector<xy>>> lo_offsets;
-
-		auto load_grp = [&](data_reader_le r) {
-			size_t index = grps.size();
-			grps.push_back(read_grp(r));
-			return index;
-		};
 		auto load_offsets = [&](data_reader_le r) {
 			auto base_r = r;
-			lo_offsets.emplace_back();
-			auto& offs = lo_offsets.back();
+			a_vector<a_vector<xy>> offs;
 
 			size_t frame_count = r.get<uint32_t>();
 			size_t offset_count = r.get<uint32_t>();
@@ -22419,11 +23184,22 @@ void global_init(global_state& st, load_data_file_F&& load_data_file) {
 				}
 			}
 
-			return lo_offsets.size() - 1;
+			return offs;
+		};
+
+		// Indices are assigned here in the same order as they would be by loading every
+		// file as it is first referenced; the files themselves are loaded afterwards.
+		struct file_load_t {
+			a_string filename;
+			bool is_grp;
+			size_t index;
 		};
+		a_vector<file_load_t> file_loads;
+		size_t grp_count = 1; // null/invalid entry
+		size_t lo_offsets_count = 1;
 
 		a_unordered_map<size_t, size_t> loaded;
-		auto load = [&](int index, std::function<size_t(data_reader_le)> f) {
+		auto load = [&](int index, bool is_grp) {
 			if (!index) return (size_t)0;
 			auto in = loaded.emplace(index, 0);
 			if (!in.second) return in.first->second;
@@ -22435,10 +23211,8 @@ void global_init(global_state& st, load_data_file_F&& load_data_file) {
 			a_string fn;
 			while (char c = r.get<char>()) fn += c;
 
-			a_vector<uint8_t> data;
-			load_data_file(data, format("unit/%s", fn));
-			data_reader_le data_r(data.data(), data.data() + data.size());
-			size_t loaded_index = f(data_r);
+			size_t loaded_index = is_grp ? grp_count++ : lo_offsets_count++;
+			file_loads.push_back({format("unit/%s", fn), is_grp, loaded_index});
 			in.first->second = loaded_index;
 			return loaded_index;
 		};
@@ -22446,20 +23220,29 @@ void global_init(global_state& st, load_data_file_F&& load_data_file) {
 		a_vector<size_t> image_grp_index;
 		std::array<a_vector<size_t>, 6> lo_indices;
 
-		grps.emplace_back(); // null/invalid entry
-		lo_offsets.emplace_back();
-
 		for (size_t i = 0; i != 999; ++i) {
 			const image_type_t* image_type = get_image_type((ImageTypes)i);
-			image_grp_index.push_back(load(image_type->grp_filename_index, load_grp));
-			lo_indices[0].push_back(load(image_type->attack_filename_index, load_offsets));
-			lo_indices[1].push_back(load(image_type->damage_filename_index, load_offsets));
-			lo_indices[2].push_back(load(image_type->special_filename_index, load_offsets));
-			lo_indices[3].push_back(load(image_type->landing_dust_filename_index, load_offsets));
-			lo_indices[4].push_back(load(image_type->lift_off_filename_index, load_offsets));
-			lo_indices[5].push_back(load(image_type->shield_filename_index, load_offsets));
+			image_grp_index.push_back(load(image_type->grp_filename_index, true));
+			lo_indices[0].push_back(load(image_type->attack_filename_index, false));
+			lo_indices[1].push_back(load(image_type->damage_filename_index, false));
+			lo_indices[2].push_back(load(image_type->special_filename_index, false));
+			lo_indices[3].push_back(load(image_type->landing_dust_filename_index, false));
+			lo_indices[4].push_back(load(image_type->lift_off_filename_index, false));
+			lo_indices[5].push_back(load(image_type->shield_filename_index, false));
 		}
 
+		a_vector<grp_t> grps(grp_count);
+		a_vector<a_vector<a_vector<xy>>> lo_offsets(lo_offsets_count);
+
+		parallel_for(file_loads.size(), [&](size_t i) {
+			auto& v = file_loads[i];
+			a_vector<uint8_t> data;
+			load_data_file(data, v.filename);
+			data_reader_le data_r(data.data(), data.data() + data.size());
+			if (v.is_grp) grps[v.index] = read_grp_lazy(std::move(data));
+			else lo_offsets[v.index] = load_offsets(data_r);
+		});
+
 		st.grps = std::move(grps);
 		st.image_grp.resize(image_grp_index.size());
 		for (size_t i = 0; i != image_grp_index.size(); ++i) {
@@ -22475,22 +23258,53 @@ void global_init(global_state& st, load_data_file_F&& load_data_file) {
 
 	};
 
-	load_data_file(st.units_dat, "arr/units.dat");
-	load_data_file(st.weapons_dat, "arr/weapons.dat");
-	load_data_file(st.upgrades_dat, "arr/upgrades.dat");
-	load_data_file(st.techdata_dat, "arr/techdata.dat");
+	std::array<const char*, 8> tileset_names = {
+		"badlands", "platform", "install", "AshWorld", "Jungle", "Desert", "Ice", "Twilight"
+	};
 
-	load_data_file(st.melee_trg, "triggers/Melee.trg");
+	// Every task writes to different fields of st. The images task needs images.dat,
+	// so it loads it itself before going on to the GRP and LO* files.
+	a_vector<std::function<void()>> tasks;
+	tasks.push_back(load_iscript_bin);
+	tasks.push_back([&]() {
+		a_vector<uint8_t> buf;
+		load_data_file(buf, "arr/images.dat");
+		st.image_types = data_loading::load_images_dat(buf);
+		load_images();
+	});
+	tasks.push_back([&]() {
+		a_vector<uint8_t> buf;
+		load_data_file(buf, "arr/flingy.dat");
+		st.flingy_types = data_loading::load_flingy_dat(buf);
+	});
+	tasks.push_back([&]() {
+		a_vector<uint8_t> buf;
+		load_data_file(buf, "arr/sprites.dat");
+		st.sprite_types = data_loading::load_sprites_dat(buf);
+	});
+	tasks.push_back([&]() {
+		a_vector<uint8_t> buf;
+		load_data_file(buf, "arr/orders.dat");
+		st.order_types = data_loading::load_orders_dat(buf);
+	});
+	auto add_file_task = [&](a_vector<uint8_t>& dst, a_string filename) {
+		tasks.push_back([&dst, filename, &load_data_file]() {
+			load_data_file(dst, filename);
+		});
+	};
+	add_file_task(st.units_dat, "arr/units.dat");
+	add_file_task(st.weapons_dat, "arr/weapons.dat");
+	add_file_task(st.upgrades_dat, "arr/upgrades.dat");
+	add_file_task(st.techdata_dat, "arr/techdata.dat");
+	add_file_task(st.melee_trg, "triggers/Melee.trg");
+	for (size_t i = 0; i != 8; ++i) {
+		add_file_task(st.tileset_vf4[i], format("Tileset/%s.vf4", tileset_names.at(i)));
+		add_file_task(st.tileset_cv5[i], format("Tileset/%s.cv5", tileset_names.at(i)));
+	}
 
-	a_vector<uint8_t> buf;
-	load_data_file(buf, "arr/flingy.dat");
-	st.flingy_types = data_loading::load_flingy_dat(buf);
-	load_data_file(buf, "arr/sprites.dat");
-	st.sprite_types = data_loading::load_sprites_dat(buf);
-	load_data_file(buf, "arr/images.dat");
-	st.image_types = data_loading::load_images_dat(buf);
-	load_data_file(buf, "arr/orders.dat");
-	st.order_types = data_loading::load_orders_dat(buf);
+	parallel_for(tasks.size(), [&](size_t i) {
+		tasks[i]();
+	});
 
 	auto fixup_sprite_type = [&](auto& ptr) {
 		SpriteTypes index{ptr};
@@ -22510,18 +23324,6 @@ void global_init(global_state& st, load_data_file_F&& load_data_file) {
 		fixup_image_type(v.image);
 	}
 
-	load_iscript_bin();
-	load_images();
-
-	std::array<const char*, 8> tileset_names = {
-		"badlands", "platform", "install", "AshWorld", "Jungle", "Desert", "Ice", "Twilight"
-	};
-
-	for (size_t i = 0; i != 8; ++i) {
-		load_data_file(st.tileset_vf4[i], format("Tileset/%s.vf4", tileset_names.at(i)));
-		load_data_file(st.tileset_cv5[i], format("Tileset/%s.cv5", tileset_names.at(i)));
-	}
-
 }
 
 struct game_player {
@@ -22545,13 +23347,21 @@ public:
 	}
 	template<typename load_data_file_F>
 	void init(load_data_file_F&& load_data_file) {
+		init_global([&](global_state& global_st) {
+			global_init(global_st, std::forward<load_data_file_F>(load_data_file));
+		});
+	}
+	// Like init, but global_init_f(global_state&) is responsible for initializing the
+	// global state, eg. through global_init_cached.
+	template<typename global_init_F>
+	void init_global(global_init_F&& global_init_f) {
 		uptr_global_st = std::make_unique<global_state>();
 		uptr_game_st = std::make_unique<game_state>();
 		uptr_st = std::make_unique<state>();
 		state& st = *uptr_st;
 		st.global = uptr_global_st.get();
 		st.game = uptr_game_st.get();
-		global_init(*uptr_global_st, std::forward<load_data_file_F>(load_data_file));
+		global_init_f(*uptr_global_st);
 		set_st(st);
 	}
 	void load_map_file(const a_string& filename, bool initial_processing = true) {
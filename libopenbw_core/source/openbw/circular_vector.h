@@ -251,50 +251,6 @@ private:
 		return circular_vector_allocator_container<allocator_T, std::is_empty<allocator_T>::value>::get_allocator();
 	}
 
-	template<typename... args_T, typename VT = T, typename std::enable_if<std::is_nothrow_move_constructible<VT>::value>::type* = nullptr>
-	pointer m_reallocate(size_t new_capacity, args_T&&... args) {
-		pointer new_data = get_allocator().allocate(new_capacity + 1);
-		pointer dst = new_data;
-		pointer new_end = new_data + new_capacity + 1;
-		for (pointer src = m_begin; src != m_end; src = next(src), ++dst) {
-			new (dst) value_type(std::move(*src));
-		}
-		try {
-			for (; dst != new_end; ++dst) {
-				new (dst) value_type(std::forward<T>(args)...);
-			}
-		} catch (...) {
-			for (pointer i = dst; i != new_data;) {
-				--i;
-				m_destroy(i);
-			}
-			get_allocator().deallocate(new_data, new_capacity + 1);
-			throw;
-		}
-		return new_data;
-	}
-	template<typename... args_T, typename VT = T, typename std::enable_if<!std::is_nothrow_move_constructible<VT>::value>::type* = nullptr>
-	pointer m_reallocate(size_t new_capacity, args_T&&... args) {
-		pointer new_data = get_allocator().allocate(new_capacity + 1);
-		pointer dst = new_data;
-		pointer new_end = new_data + new_capacity + 1;
-		try {
-			for (pointer src = m_begin; src != m_end; src = next(src), ++dst) {
-				new (dst) value_type(*src);
-			}
-			for (; dst != new_end; ++dst) {
-				new (dst) value_type(std::forward<T>(args)...);
-			}
-		} catch (...) {
-			for (pointer i = dst; i != new_data;) {
-				--i;
-				m_destroy(i);
-			}
-			get_allocator().deallocate(new_data, new_capacity + 1);
-			throw;
-		}
-		return new_data;
-	}
 	template<typename VT = T, typename std::enable_if<std::is_nothrow_move_constructible<VT>::value>::type* = nullptr>
 	pointer m_reallocate_no_construct(size_t new_capacity) {
 		pointer new_data = get_allocator().allocate(new_capacity + 1);
@@ -367,7 +323,10 @@ private:
 			increase = (0x20 + sizeof(T) - 1) / sizeof(T);
 			if (increase > remaining_cap) throw std::length_error("circular_vector exceeded maximum size");
 		}
-		size_t new_cap = cap + increase;
+		m_set_capacity(cap + increase);
+	}
+
+	void m_set_capacity(size_t new_cap) {
 		pointer new_data = m_reallocate_no_construct(new_cap);
 		pointer new_end = new_data + size();
 		m_clear();
@@ -378,30 +337,16 @@ private:
 		m_end = new_end;
 	}
 
-	template<typename... args_T>
-	void m_expand(size_t new_capacity, args_T&&...) {
-		pointer new_data = m_reallocate(new_capacity);
-		pointer new_end = new_data + size();
-		if (m_data_begin) get_allocator().deallocate(m_data_begin, m_data_end - m_data_begin);
-		m_data_begin = new_data;
-		m_data_end = m_data_begin + new_capacity + 1;
-		m_begin = new_data;
-		m_end = new_end;
-	}
-
 	template<typename... args_T>
 	void m_resize(size_type count, args_T&&... args) {
-		if (count > capacity()) {
-			m_expand(count, std::forward<args_T>(args)...);
-			return;
-		} else if (count > size()) {
+		if (count > capacity()) m_set_capacity(count);
+		if (count > size()) {
 			pointer new_end = increment(m_begin, count);
 			for (pointer i = m_end; i != new_end; i = next(i)) {
 				try {
-					new (i) value_type(std::forward<T>(args)...);
+					new (i) value_type(args...);
 				} catch (...) {
-					for (pointer i2 = i; i2 != m_end;) {
-						i = prev(i2);
+					for (pointer i2 = m_end; i2 != i; i2 = next(i2)) {
 						m_destroy(i2);
 					}
 					throw;
@@ -430,16 +375,12 @@ private:
 	template<typename iterator_T>
 	void m_assign(iterator_T begin, iterator_T end) {
 		size_t new_size = std::distance(begin, end);
-		if (size() >= new_size) {
-			pointer new_end = increment(m_begin, new_size);
-			pointer i = m_begin;
-			for (auto src = begin; i != new_end; i = next(i), ++src) {
-				new (i) value_type(*src);
-			}
-			for (; i != m_end; i = next(i)) {
-				m_destroy(i);
+		if (capacity() >= new_size) {
+			m_clear();
+			for (auto src = begin; src != end; ++src) {
+				new (m_end) value_type(*src);
+				m_end = next(m_end);
 			}
-			m_end = new_end;
 		} else {
 			pointer new_data = m_reallocate_copy(new_size, begin, end);
 			m_clear();
@@ -453,17 +394,14 @@ private:
 	}
 
 	void m_assign(const circular_vector& other) {
+		if (&other == this) return;
 		size_t new_size = other.size();
-		if (size() >= new_size) {
-			pointer new_end = increment(m_begin, new_size);
-			pointer i = m_begin;
-			for (pointer src = other.m_begin; i != new_end; i = next(i), src = other.next(src)) {
-				new (i) value_type(*src);
-			}
-			for (; i != m_end; i = next(i)) {
-				m_destroy(i);
+		if (capacity() >= new_size) {
+			m_clear();
+			for (pointer src = other.m_begin; src != other.m_end; src = other.next(src)) {
+				new (m_end) value_type(*src);
+				m_end = next(m_end);
 			}
-			m_end = new_end;
 		} else {
 			pointer new_data = m_reallocate_copy(new_size, other);
 			m_clear();
@@ -482,7 +420,7 @@ private:
 		std::swap(m_end, other.m_end);
 	}
 	void m_destroy(pointer p) {
-		get_allocator().destroy(p);
+		p->~value_type();
 	}
 public:
 	circular_vector() {}
@@ -596,6 +534,9 @@ public:
 		if (!m_data_begin) return 0;
 		return m_data_end - m_data_begin - 1;
 	}
+	void reserve(size_type new_cap) {
+		if (new_cap > capacity()) m_set_capacity(new_cap);
+	}
 	void clear() {
 		m_clear();
 	}
@@ -18,8 +18,56 @@
 
 namespace bwgame {
 
+// Building with BWGAME_COUNT_ALLOCATIONS counts every allocation made through the a_*
+// containers below (except a_string) in thread-local allocation_counters, so that
+// allocations can be measured around a call such as next_frame. on_allocate, if set,
+// is called for every allocation; a breakpoint or backtrace in it finds the call site.
+struct allocation_counters {
+	size_t allocations = 0;
+	size_t deallocations = 0;
+	size_t allocated_bytes = 0;
+	void (*on_allocate)(size_t bytes) = nullptr;
+
+	static allocation_counters& current() {
+		thread_local allocation_counters r;
+		return r;
+	}
+};
+
+template<typename T>
+struct counting_allocator {
+	using value_type = T;
+	counting_allocator() = default;
+	template<typename T2>
+	counting_allocator(const counting_allocator<T2>&) {}
+	T* allocate(size_t n) {
+		auto& c = allocation_counters::current();
+		++c.allocations;
+		c.allocated_bytes += n * sizeof(T);
+		if (c.on_allocate) c.on_allocate(n * sizeof(T));
+		return std::allocator<T>().allocate(n);
+	}
+	void deallocate(T* p, size_t n) {
+		++allocation_counters::current().deallocations;
+		std::allocator<T>().deallocate(p, n);
+	}
+	template<typename T2>
+	bool operator==(const counting_allocator<T2>&) const {
+		return true;
+	}
+	template<typename T2>
+	bool operator!=(const counting_allocator<T2>&) const {
+		return false;
+	}
+};
+
+#ifdef BWGAME_COUNT_ALLOCATIONS
+template<typename T>
+using alloc = counting_allocator<T>;
+#else
 template<typename T>
 using alloc = std::allocator<T>;
+#endif
 
 template<typename T>
 using a_vector = std::vector<T, alloc<T>>;
@@ -49,7 +97,7 @@ using a_unordered_map = std::unordered_map<key_T, value_T, hash_t, equal_to_t, a
 template<typename key_T, typename value_T, typename hash_t = std::hash<key_T>, typename equal_to_t = std::equal_to<key_T>>
 using a_unordered_multimap = std::unordered_multimap<key_T, value_T, hash_t, equal_to_t, alloc<std::pair<const key_T, value_T>>>;
 
-using a_string = std::basic_string<char, std::char_traits<char>, alloc<char>>;
+using a_string = std::basic_string<char, std::char_traits<char>, std::allocator<char>>;
 
 template<typename T>
 using a_circular_vector = circular_vector<T, alloc<T>>;
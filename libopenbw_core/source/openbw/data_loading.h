@@ -9,6 +9,21 @@
 #include <array>
 #include <cstring>
 #include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <random>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define BWGAME_HAS_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#ifdef _WIN32
+#include <io.h>
+#endif
 
 // TODO: this is UB galore isn't it?
 
@@ -87,6 +102,24 @@ T get_impl(self_T& self) {
 	return value_at<T, little_endian>((uint8_t*)&buf);
 }
 
+// A non-owning, read-only view of n values of type T stored in raw data; values are
+// decoded as they are accessed. The data must outlive the view.
+template<typename T, bool little_endian>
+struct data_view {
+	const uint8_t* data = nullptr;
+	size_t n = 0;
+	T operator[](size_t index) const {
+		return value_at<T, little_endian>(data + index * sizeof(T));
+	}
+	T at(size_t index) const {
+		if (index >= n) error("data_view: index %d out of range (size %d)", index, n);
+		return (*this)[index];
+	}
+	size_t size() const {
+		return n;
+	}
+};
+
 template<bool default_little_endian = true, bool bounds_checking = true>
 struct data_reader {
 	const uint8_t* ptr = nullptr;
@@ -115,6 +148,10 @@ struct data_reader {
 		}
 		return r;
 	}
+	template<typename T, bool little_endian = default_little_endian>
+	data_view<T, little_endian> get_view(size_t n) {
+		return {get_n(n*sizeof(T)), n};
+	}
 	void skip(size_t n) {
 		if (bounds_checking && left() < n) error("data_reader: attempt to seek past end");
 		ptr += n;
@@ -292,6 +329,182 @@ struct file_reader {
 
 };
 
+template<bool default_little_endian = true>
+struct file_writer {
+	a_string filename;
+	FILE* f = nullptr;
+	file_writer() = default;
+	explicit file_writer(a_string filename) {
+		open(std::move(filename));
+	}
+	~file_writer() {
+		if (f) fclose(f);
+	}
+	file_writer(const file_writer&) = delete;
+	file_writer(file_writer&& n) {
+		f = n.f;
+		n.f = nullptr;
+	}
+	file_writer& operator=(const file_writer&) = delete;
+	file_writer& operator=(file_writer&& n) {
+		std::swap(f, n.f);
+		return *this;
+	}
+	void open(a_string filename) {
+		if (f) fclose(f);
+		f = fopen(filename.c_str(), "wb");
+		if (!f) error("file_writer: failed to open %s for writing", filename.c_str());
+		this->filename = std::move(filename);
+	}
+	void put_bytes(const uint8_t* src, size_t n) {
+		if (n && !fwrite(src, n, 1, f)) {
+			error("file_writer: %s: write error", filename);
+		}
+	}
+	template<typename T, bool little_endian = default_little_endian>
+	void put(T v) {
+		static_assert(std::is_integral<T>::value, "data_writer: don't know how to write this type");
+		put_bytes((const uint8_t*)&v, sizeof(v));
+	}
+	void seek(size_t offset) {
+		if ((size_t)(long)offset != offset || fseek(f, (long)offset, SEEK_SET)) error("file_writer: %s: failed to seek to offset %d", filename, offset);
+	}
+	void flush() {
+		if (fflush(f)) error("file_writer: %s: flush error", filename);
+	}
+	// Cuts the file off at new_size bytes. The position is left unchanged.
+	void truncate(size_t new_size) {
+		flush();
+#if defined(_WIN32)
+		if (_chsize_s(_fileno(f), (long long)new_size)) error("file_writer: %s: failed to truncate to %d bytes", filename, new_size);
+#elif defined(BWGAME_HAS_MMAP)
+		if (ftruncate(fileno(f), (off_t)new_size)) error("file_writer: %s: failed to truncate to %d bytes", filename, new_size);
+#else
+		if (new_size < size()) error("file_writer: %s: truncating files is not supported on this platform", filename);
+#endif
+	}
+	bool eof() {
+		return feof(f);
+	}
+	size_t left() const {
+		return size() - tell();
+	}
+	size_t tell() const {
+		return (size_t)ftell(f);
+	}
+	size_t size() {
+		auto prev_pos = ftell(f);
+		fseek(f, 0, SEEK_END);
+		auto r = ftell(f);
+		fseek(f, prev_pos, SEEK_SET);
+		return r;
+	}
+};
+
+// Read-only view of a whole file. Uses mmap where available, otherwise the file is read into memory.
+struct mapped_file {
+	a_string filename;
+#ifdef BWGAME_HAS_MMAP
+	const uint8_t* ptr = nullptr;
+	size_t file_size = 0;
+#else
+	a_vector<uint8_t> buffer;
+#endif
+	mapped_file() = default;
+	explicit mapped_file(a_string filename) {
+		open(std::move(filename));
+	}
+	~mapped_file() {
+		close();
+	}
+	mapped_file(const mapped_file&) = delete;
+	mapped_file& operator=(const mapped_file&) = delete;
+
+	void open(a_string filename) {
+		close();
+		this->filename = std::move(filename);
+#ifdef BWGAME_HAS_MMAP
+		int fd = ::open(this->filename.c_str(), O_RDONLY);
+		if (fd == -1) error("mapped_file: failed to open %s for reading", this->filename);
+		struct stat s;
+		if (fstat(fd, &s)) {
+			::close(fd);
+			error("mapped_file: %s: failed to get size", this->filename);
+		}
+		file_size = (size_t)s.st_size;
+		if (file_size) {
+			void* p = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			::close(fd);
+			if (p == MAP_FAILED) error("mapped_file: %s: mmap failed", this->filename);
+			ptr = (const uint8_t*)p;
+		} else ::close(fd);
+#else
+		file_reader<> r(this->filename);
+		buffer = r.get_vec<uint8_t>(r.size());
+#endif
+	}
+
+	void close() {
+#ifdef BWGAME_HAS_MMAP
+		if (ptr) munmap((void*)ptr, file_size);
+		ptr = nullptr;
+		file_size = 0;
+#else
+		buffer.clear();
+#endif
+	}
+
+#ifdef BWGAME_HAS_MMAP
+	const uint8_t* data() const {
+		return ptr;
+	}
+	size_t size() const {
+		return file_size;
+	}
+#else
+	const uint8_t* data() const {
+		return buffer.data();
+	}
+	size_t size() const {
+		return buffer.size();
+	}
+#endif
+};
+
+// Writes filename through f(file_writer<>&), going through a temporary file that is
+// renamed into place, so that readers (including other processes) never see a
+// partially written file.
+template<typename F>
+void replace_file(const a_string& filename, F&& f) {
+	a_string tmp_filename = format("%s.%08x.tmp", filename, (uint32_t)std::random_device()());
+	try {
+		file_writer<> w(tmp_filename);
+		f(w);
+		w.flush();
+	} catch (...) {
+		std::remove(tmp_filename.c_str());
+		throw;
+	}
+	if (std::rename(tmp_filename.c_str(), filename.c_str())) {
+		std::remove(tmp_filename.c_str());
+		error("replace_file: failed to rename %s to %s", tmp_filename, filename);
+	}
+}
+
+// A fast non-cryptographic 64-bit hash, for cache keys and the like.
+static inline uint64_t hash_bytes(const uint8_t* data, size_t size, uint64_t h = 0xcbf29ce484222325) {
+	const uint64_t prime = 0x100000001b3;
+	size_t n = size / 8;
+	for (size_t i = 0; i != n; ++i) {
+		uint64_t v;
+		memcpy(&v, data + i * 8, 8);
+		h = (h ^ v) * prime;
+		h ^= h >> 29;
+	}
+	for (size_t i = n * 8; i != size; ++i) h = (h ^ data[i]) * prime;
+	return (h ^ size) * prime;
+}
+
 using crypt_table_t = std::array<uint32_t, 256 * 5>;
 static auto get_crypt_table() {
 	uint32_t n = 0x100001;
@@ -1322,16 +1535,41 @@ struct data_files_loader {
 	}
 };
 
+static inline a_vector<a_string> data_files_directory_mpqs(a_string path) {
+	if (!path.empty() && path[path.size() - 1] != '/' && path[path.size() - 1] != '\\') path += '/';
+	return {path + "Patch_rt.mpq", path + "BrooDat.mpq", path + "StarDat.mpq"};
+}
+
 template<typename data_files_loader_T = data_files_loader<>>
 data_files_loader_T data_files_directory(a_string path) {
-	if (!path.empty() && path[path.size() - 1] != '/' && path[path.size() - 1] != '\\') path += '/';
 	data_files_loader_T r;
-	r.add_mpq_file(path + "Patch_rt.mpq");
-	r.add_mpq_file(path + "BrooDat.mpq");
-	r.add_mpq_file(path + "StarDat.mpq");
+	for (auto& v : data_files_directory_mpqs(std::move(path))) r.add_mpq_file(std::move(v));
 	return r;
 }
 
+// A data_files_directory that may be called from several threads at once, as global_init
+// does when given a thread pool. Each thread reads through its own set of open MPQs, so
+// reads and decompression run concurrently.
+template<typename data_files_loader_T = data_files_loader<>>
+struct concurrent_data_files_directory {
+	a_string path;
+	std::mutex mut;
+	a_unordered_map<std::thread::id, std::unique_ptr<data_files_loader_T>> loaders;
+
+	explicit concurrent_data_files_directory(a_string path) : path(std::move(path)) {}
+
+	void operator()(a_vector<uint8_t>& dst, a_string filename) {
+		data_files_loader_T* loader;
+		{
+			std::lock_guard<std::mutex> l(mut);
+			auto& v = loaders[std::this_thread::get_id()];
+			if (!v) v = std::make_unique<data_files_loader_T>(data_files_directory<data_files_loader_T>(path));
+			loader = v.get();
+		}
+		(*loader)(dst, std::move(filename));
+	}
+};
+
 template<typename to_T, typename from_T>
 struct data_type_cast_helper {
 	to_T operator()(from_T v) {
@@ -5,6 +5,10 @@
 #include "util.h"
 #include "containers.h"
 
+#include <cstring>
+#include <memory>
+#include <mutex>
+
 namespace bwgame {
 
 struct unit_type_t;
@@ -482,19 +486,35 @@ struct iscript_t {
 		a_vector<size_t> animation_pc;
 	};
 	a_unordered_map<int, script> scripts;
-	a_vector<int> program_data;
+	// Opcodes are one byte, followed by their operands at their iscript.bin widths
+	// (little endian). Jump and branch targets are 32-bit offsets into program_data;
+	// offset 0 is invalid.
+	a_vector<uint8_t> program_data;
 };
 
 struct grp_t {
 	struct frame_t {
 		xy_t<size_t> offset;
 		xy_t<size_t> size;
-		a_vector<size_t> line_data_offset;
-		a_vector<uint8_t> data_container;
+		// Points into grp_t::data: size.y 32-bit line offsets, relative to data,
+		// followed by the line data. null until the pixel data has been decoded.
+		const uint8_t* data = nullptr;
+
+		const uint8_t* line_data(size_t y) const {
+			uint32_t line_offset;
+			memcpy(&line_offset, data + y * 4, 4);
+			return data + line_offset;
+		}
 	};
 	size_t width;
 	size_t height;
 	a_vector<frame_t> frames;
+	// The pixel data of all frames. Moving a grp_t does not invalidate frame_t::data.
+	a_vector<uint8_t> data;
+	// Set for grps whose pixel data is decoded on first use (see read_grp_lazy);
+	// file_data is released once that has happened.
+	a_vector<uint8_t> file_data;
+	std::unique_ptr<std::once_flag> decode_once;
 };
 
 }
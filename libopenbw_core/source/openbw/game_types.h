@@ -11,25 +11,31 @@ struct sprite_t;
 struct flingy_t;
 struct unit_t;
 
-template<typename T>
+template<typename T, size_t index_bits_v = 11>
 struct unit_id_t {
+	static const size_t index_bits = index_bits_v;
+	static const size_t generation_bits = int_bits<T>::value - index_bits;
 	T raw_value = 0;
 	unit_id_t() = default;
 	explicit unit_id_t(T raw_value) : raw_value(raw_value) {}
-	explicit unit_id_t(size_t index, unsigned int generation) : raw_value((T)(index | generation << 11)) {}
+	explicit unit_id_t(size_t index, unsigned int generation) : raw_value((T)(index | (size_t)generation << index_bits)) {}
 	bool operator==(const unit_id_t& n) const {
 		return raw_value == n.raw_value;
 	}
 	size_t index() const {
-		return raw_value & 0x7ff;
+		return raw_value & (((T)1 << index_bits) - 1);
 	}
 	unsigned int generation() const {
-		return raw_value >> 11;
+		return raw_value >> index_bits;
 	}
 };
 
+// unit_id is the form used in actions: 11 bits for the index (plus one) and 5 for the
+// generation. unit_id_32 is used to refer to units everywhere else, and has room for many
+// more units. It has the same 5 bits of generation, so that a unit id goes stale exactly
+// when it does in Brood War.
 using unit_id = unit_id_t<uint16_t>;
-using unit_id_32 = unit_id_t<uint32_t>;
+using unit_id_32 = unit_id_t<uint32_t, 27>;
 
 struct default_link_f {
 	template<typename T>
@@ -44,22 +50,64 @@ static void bw_insert_list(cont_T& cont, T& v) {
 	else cont.insert(std::next(cont.begin()), v);
 }
 
-template<typename T, size_t max_size, size_t allocation_granularity>
+template<typename T>
 struct object_container {
-	a_deque<std::array<T, allocation_granularity>> list;
+	// Storage for all max_size objects is allocated by the first grow, so objects are
+	// found by direct indexing and never move. They are still constructed
+	// allocation_granularity at a time, so memory that is never used is never touched.
+	T* list = nullptr;
 	intrusive_list<T, default_link_f> free_list;
 	size_t size = 0;
+	size_t max_size;
+	size_t allocation_granularity;
+
+	object_container(size_t max_size, size_t allocation_granularity) : max_size(max_size), allocation_granularity(allocation_granularity) {}
+	object_container(const object_container&) = delete;
+	object_container(object_container&& n) : list(n.list), free_list(std::move(n.free_list)), size(n.size), max_size(n.max_size), allocation_granularity(n.allocation_granularity) {
+		n.list = nullptr;
+		n.size = 0;
+	}
+	object_container& operator=(const object_container&) = delete;
+	object_container& operator=(object_container&& n) {
+		std::swap(list, n.list);
+		std::swap(free_list, n.free_list);
+		std::swap(size, n.size);
+		std::swap(max_size, n.max_size);
+		std::swap(allocation_granularity, n.allocation_granularity);
+		return *this;
+	}
+	~object_container() {
+		if (!list) return;
+		for (size_t i = 0; i != size; ++i) list[i].~T();
+		alloc<T>().deallocate(list, max_size);
+	}
+
+	// Destroys all objects, keeping max_size and allocation_granularity.
+	void clear() {
+		*this = object_container(max_size, allocation_granularity);
+	}
+
+	void set_max_size(size_t new_max_size) {
+		if (new_max_size == max_size) return;
+		if (list) error("object_container: max_size can not be changed after objects have been created");
+		if (new_max_size == 0) error("object_container: max_size can not be 0");
+		max_size = new_max_size;
+	}
+
+	size_t position(size_t index) const {
+		return index ? max_size - index : 0;
+	}
 
 	T* get(size_t index, bool add_new_to_free = true) {
-		if (index) index = max_size - index;
+		index = position(index);
 		while (size <= index) grow(add_new_to_free);
-		return &list[index / allocation_granularity][index % allocation_granularity];
+		return &list[index];
 	}
 
 	const T* try_get(size_t index) const {
-		if (index) index = max_size - index;
+		index = position(index);
 		if (size <= index) return nullptr;
-		return &list[index / allocation_granularity][index % allocation_granularity];
+		return &list[index];
 	}
 
 	T* try_get(size_t index) {
@@ -68,23 +116,23 @@ struct object_container {
 
 
 	T* at(size_t index) {
-		if (index) index = max_size - index;
+		index = position(index);
 		if (size <= index) error("object_container::get const: invalid index %u", index);
-		return &list[index / allocation_granularity][index % allocation_granularity];
+		return &list[index];
 	}
 
 	const T* at(size_t index) const {
-		if (index) index = max_size - index;
+		index = position(index);
 		if (size <= index) error("object_container::get const: invalid index %u", index);
-		return &list[index / allocation_granularity][index % allocation_granularity];
+		return &list[index];
 	}
 
 	void grow(bool add_new_to_free) {
 		if (size == max_size) error("object_container: attempt to grow beyond max_size");
-		list.emplace_back();
+		if (!list) list = alloc<T>().allocate(max_size);
 		size_t n = std::min(allocation_granularity, max_size - size);
 		for (size_t i = 0; i != n; ++i) {
-			T* obj = &list.back()[i];
+			T* obj = new (&list[size]) T();
 			obj->index = size == 0 ? 0 : max_size - size;
 			if (add_new_to_free) free_list.push_back(*obj);
 			++size;
@@ -110,6 +158,33 @@ struct object_container {
 	}
 };
 
+// Storage for objects that are handed out by pointer and recycled through a free list
+// kept by the caller. Room for max_size objects is allocated by the first emplace, so
+// pointers stay valid and everything is released with a single deallocation.
+template<typename T>
+struct object_arena {
+	a_vector<T> vec;
+	size_t max_size;
+
+	explicit object_arena(size_t max_size) : max_size(max_size) {}
+
+	size_t size() const {
+		return vec.size();
+	}
+
+	template<typename... args_T>
+	T* emplace(args_T&&... args) {
+		if (vec.size() == max_size) error("object_arena: attempt to grow beyond max_size");
+		if (vec.capacity() < max_size) vec.reserve(max_size);
+		vec.emplace_back(std::forward<args_T>(args)...);
+		return &vec.back();
+	}
+
+	void clear() {
+		vec.clear();
+	}
+};
+
 enum struct race_t {
 	zerg,
 	terran,
@@ -146,7 +221,6 @@ struct sight_values_t {
 	struct maskdat_node_t {
 		size_t prev;
 		size_t prev2;
-		int relative_tile_index;
 		int x;
 		int y;
 	};
@@ -154,7 +228,8 @@ struct sight_values_t {
 	int min_width, min_height;
 	int min_mask_size;
 	int ext_masked_count;
-	a_vector<maskdat_node_t> maskdat;
+	// The first min_mask_size + ext_masked_count entries are used.
+	std::array<maskdat_node_t, 25 * 25> maskdat;
 };
 
 struct trigger {
@@ -545,7 +620,7 @@ struct path_t: link_base {
 	xy destination;
 	xy next;
 
-	unit_id last_collision_unit;
+	unit_id_32 last_collision_unit;
 	fp8 last_collision_speed;
 	direction_t slide_free_direction;
 
@@ -633,7 +708,7 @@ struct unit_t: flingy_t {
 	fp8 shield_construction_rate;
 	int remaining_build_time;
 	int previous_hp;
-	std::array<unit_id, 8> loaded_units;
+	std::array<unit_id_32, 8> loaded_units;
 
 	struct fighter_link {
 		auto* operator()(unit_t* ptr) {
@@ -773,6 +848,10 @@ struct unit_t: flingy_t {
 	std::array<bool, 4> unit_finder_visited;
 	size_t unit_finder_index_from;
 	size_t unit_finder_index_to;
+
+	// Set once shield, hit point and energy regeneration have nothing left to do, so that
+	// update_unit_values can skip them. See state_functions::wake_unit_regen.
+	bool regen_idle;
 };
 
 }
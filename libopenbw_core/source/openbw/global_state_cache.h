@@ -0,0 +1,267 @@
+#ifndef BWGAME_GLOBAL_STATE_CACHE_H
+#define BWGAME_GLOBAL_STATE_CACHE_H
+
+#include "bwgame.h"
+
+namespace bwgame {
+
+// A snapshot of a fully initialized global_state, so that global_init only needs to
+// run once per set of data files.
+//
+// The file is a header followed by every container of global_state, in declaration
+// order, as a 64-bit element count and the raw element bytes. Pointers are not
+// stored; they are rebuilt from the type ids and indices after loading.
+// The header holds the sizes of the element types, so a cache written by a build
+// with a different layout is rejected rather than misread. key is supplied by the
+// caller and identifies the source data files (see data_files_key).
+//
+//   u32 identifier, u32 version, u64 key, u32 sizes[8]
+//
+// Caches are neither portable between architectures nor meant to be; they are
+// rebuilt whenever they fail to load.
+namespace global_state_cache {
+
+static const uint32_t identifier = 0x43534742; // 'BGSC'
+static const uint32_t version = 4;
+
+template<typename T>
+static void check_pod() {
+	static_assert(std::is_trivially_copyable<T>::value, "global_state_cache: type can not be stored as raw bytes");
+}
+
+static std::array<uint32_t, 8> type_sizes() {
+	return {
+		(uint32_t)sizeof(flingy_type_t), (uint32_t)sizeof(sprite_type_t), (uint32_t)sizeof(image_type_t), (uint32_t)sizeof(order_type_t),
+		(uint32_t)sizeof(xy), (uint32_t)sizeof(xy_t<size_t>), (uint32_t)sizeof(size_t), (uint32_t)sizeof(int)
+	};
+}
+
+template<typename writer_T>
+struct writer {
+	writer_T& w;
+
+	template<typename T>
+	void put_vec(const a_vector<T>& vec) {
+		check_pod<T>();
+		w.template put<uint64_t>(vec.size());
+		w.put_bytes((const uint8_t*)vec.data(), vec.size() * sizeof(T));
+	}
+
+	void put_state(const global_state& st) {
+		put_vec(st.flingy_types.vec);
+		put_vec(st.sprite_types.vec);
+		put_vec(st.image_types.vec);
+		put_vec(st.order_types.vec);
+
+		w.template put<uint64_t>(st.iscript.scripts.size());
+		for (auto& v : st.iscript.scripts) {
+			w.template put<int32_t>(v.second.id);
+			put_vec(v.second.animation_pc);
+		}
+		put_vec(st.iscript.program_data);
+
+		w.template put<uint64_t>(st.grps.size());
+		for (auto& grp : st.grps) {
+			w.template put<uint64_t>(grp.width);
+			w.template put<uint64_t>(grp.height);
+			w.template put<uint64_t>(grp.frames.size());
+			for (auto& f : grp.frames) {
+				w.template put<uint64_t>(f.offset.x);
+				w.template put<uint64_t>(f.offset.y);
+				w.template put<uint64_t>(f.size.x);
+				w.template put<uint64_t>(f.size.y);
+				w.template put<uint64_t>(f.data ? (uint64_t)(f.data - grp.data.data()) : ~(uint64_t)0);
+			}
+			put_vec(grp.data);
+			put_vec(grp.file_data);
+		}
+		a_vector<uint32_t> image_grp_index;
+		for (auto* v : st.image_grp) image_grp_index.push_back((uint32_t)(v - st.grps.data()));
+		put_vec(image_grp_index);
+
+		w.template put<uint64_t>(st.lo_offsets.size());
+		for (auto& v : st.lo_offsets) {
+			w.template put<uint64_t>(v.size());
+			for (auto& v2 : v) put_vec(v2);
+		}
+		a_vector<uint32_t> image_lo_index;
+		for (auto& v : st.image_lo_offsets) {
+			for (auto* v2 : v) image_lo_index.push_back((uint32_t)(v2 - st.lo_offsets.data()));
+		}
+		put_vec(image_lo_index);
+
+		put_vec(st.units_dat);
+		put_vec(st.weapons_dat);
+		put_vec(st.upgrades_dat);
+		put_vec(st.techdata_dat);
+		put_vec(st.melee_trg);
+		for (auto& v : st.tileset_vf4) put_vec(v);
+		for (auto& v : st.tileset_cv5) put_vec(v);
+	}
+};
+
+struct reader {
+	data_loading::data_reader_le r;
+
+	size_t get_count(size_t element_size) {
+		uint64_t n = r.get<uint64_t>();
+		if (element_size && n > r.left() / element_size) error("global_state_cache: corrupt element count");
+		return (size_t)n;
+	}
+
+	template<typename T>
+	void get_vec(a_vector<T>& vec) {
+		check_pod<T>();
+		vec.resize(get_count(sizeof(T)));
+		r.get_bytes((uint8_t*)vec.data(), vec.size() * sizeof(T));
+	}
+
+	void get_state(global_state& st) {
+		get_vec(st.flingy_types.vec);
+		get_vec(st.sprite_types.vec);
+		get_vec(st.image_types.vec);
+		get_vec(st.order_types.vec);
+		if (st.sprite_types.vec.size() != 517 || st.image_types.vec.size() != 999) error("global_state_cache: invalid type counts");
+
+		for (auto& v : st.flingy_types.vec) {
+			SpriteTypes index{v.sprite};
+			if (index == SpriteTypes::None) v.sprite = nullptr;
+			else if ((size_t)index < 517) v.sprite = &st.sprite_types.vec[(size_t)index];
+			else error("global_state_cache: invalid sprite id %d", (size_t)index);
+		}
+		for (auto& v : st.sprite_types.vec) {
+			ImageTypes index{v.image};
+			if (index == ImageTypes::None) v.image = nullptr;
+			else if ((size_t)index < 999) v.image = &st.image_types.vec[(size_t)index];
+			else error("global_state_cache: invalid image id %d", (size_t)index);
+		}
+
+		st.iscript.scripts.clear();
+		for (size_t i = get_count(4); i; --i) {
+			int id = r.get<int32_t>();
+			auto& s = st.iscript.scripts[id];
+			s.id = id;
+			get_vec(s.animation_pc);
+		}
+		get_vec(st.iscript.program_data);
+
+		st.grps.resize(get_count(40));
+		for (auto& grp : st.grps) {
+			grp.width = (size_t)r.get<uint64_t>();
+			grp.height = (size_t)r.get<uint64_t>();
+			grp.frames.resize(get_count(40));
+			a_vector<uint64_t> frame_data_offset;
+			for (auto& f : grp.frames) {
+				f.offset.x = (size_t)r.get<uint64_t>();
+				f.offset.y = (size_t)r.get<uint64_t>();
+				f.size.x = (size_t)r.get<uint64_t>();
+				f.size.y = (size_t)r.get<uint64_t>();
+				frame_data_offset.push_back(r.get<uint64_t>());
+			}
+			get_vec(grp.data);
+			for (size_t i = 0; i != grp.frames.size(); ++i) {
+				uint64_t offset = frame_data_offset[i];
+				if (offset == ~(uint64_t)0) continue;
+				if (offset > grp.data.size() || grp.frames[i].size.y * 4 > grp.data.size() - offset) error("global_state_cache: invalid frame data offset");
+				grp.frames[i].data = grp.data.data() + offset;
+			}
+			get_vec(grp.file_data);
+			if (!grp.file_data.empty()) grp.decode_once = std::make_unique<std::once_flag>();
+		}
+		a_vector<uint32_t> image_grp_index;
+		get_vec(image_grp_index);
+		st.image_grp.resize(image_grp_index.size());
+		for (size_t i = 0; i != image_grp_index.size(); ++i) {
+			st.image_grp[i] = &st.grps.at(image_grp_index[i]);
+		}
+
+		st.lo_offsets.resize(get_count(8));
+		for (auto& v : st.lo_offsets) {
+			v.resize(get_count(8));
+			for (auto& v2 : v) get_vec(v2);
+		}
+		a_vector<uint32_t> image_lo_index;
+		get_vec(image_lo_index);
+		st.image_lo_offsets.resize(image_lo_index.size() / 6);
+		for (size_t i = 0; i != st.image_lo_offsets.size(); ++i) {
+			for (size_t i2 = 0; i2 != 6; ++i2) {
+				st.image_lo_offsets[i][i2] = &st.lo_offsets.at(image_lo_index[i * 6 + i2]);
+			}
+		}
+
+		get_vec(st.units_dat);
+		get_vec(st.weapons_dat);
+		get_vec(st.upgrades_dat);
+		get_vec(st.techdata_dat);
+		get_vec(st.melee_trg);
+		for (auto& v : st.tileset_vf4) get_vec(v);
+		for (auto& v : st.tileset_cv5) get_vec(v);
+		if (r.left()) error("global_state_cache: trailing data");
+	}
+};
+
+}
+
+// Identifies the contents of the MPQs that data_files_directory(path) would read.
+// Every byte is hashed, which costs a few tens of milliseconds; much less than global_init.
+static inline uint64_t data_files_key(a_string path) {
+	uint64_t r = 0xcbf29ce484222325;
+	for (auto& fn : data_loading::data_files_directory_mpqs(std::move(path))) {
+		data_loading::mapped_file f(fn);
+		r = data_loading::hash_bytes(f.data(), f.size(), r);
+	}
+	return r;
+}
+
+// Loads a cache written by save_global_state_cache. Returns false if the file does not
+// exist, was written with a different key or layout, or is otherwise unusable; st is
+// left in an unspecified state in that case.
+static inline bool load_global_state_cache(global_state& st, a_string filename, uint64_t key) {
+	data_loading::mapped_file f;
+	try {
+		f.open(std::move(filename));
+	} catch (const std::exception&) {
+		return false;
+	}
+	try {
+		data_loading::data_reader_le r(f.data(), f.data() + f.size());
+		if (r.get<uint32_t>() != global_state_cache::identifier) return false;
+		if (r.get<uint32_t>() != global_state_cache::version) return false;
+		if (r.get<uint64_t>() != key) return false;
+		auto sizes = global_state_cache::type_sizes();
+		for (auto v : sizes) {
+			if (r.get<uint32_t>() != v) return false;
+		}
+		global_state_cache::reader{r}.get_state(st);
+	} catch (const std::exception&) {
+		return false;
+	}
+	return true;
+}
+
+// Writes the cache through data_loading::replace_file, so concurrent processes never
+// observe a partially written cache.
+static inline void save_global_state_cache(const global_state& st, a_string filename, uint64_t key) {
+	data_loading::replace_file(filename, [&](data_loading::file_writer<>& w) {
+		w.put<uint32_t>(global_state_cache::identifier);
+		w.put<uint32_t>(global_state_cache::version);
+		w.put<uint64_t>(key);
+		for (auto v : global_state_cache::type_sizes()) w.put<uint32_t>(v);
+		global_state_cache::writer<data_loading::file_writer<>>{w}.put_state(st);
+	});
+}
+
+// global_init for the data files in data_path, going through the cache at cache_filename.
+// The cache is (re)built if it is missing or does not match the data files.
+static inline void global_init_cached(global_state& st, a_string data_path, a_string cache_filename, thread_pool* pool = nullptr) {
+	uint64_t key = data_files_key(data_path);
+	if (load_global_state_cache(st, cache_filename, key)) return;
+	st = global_state();
+	if (pool) global_init(st, data_loading::concurrent_data_files_directory<>(std::move(data_path)), pool);
+	else global_init(st, data_loading::data_files_directory(std::move(data_path)));
+	save_global_state_cache(st, std::move(cache_filename), key);
+}
+
+}
+
+#endif
@@ -21,8 +21,8 @@ struct crc32_t {
 			table[i] = v;
 		}
 	}
-	uint32_t operator()(const uint8_t* data, size_t data_size) {
-		uint32_t r = 0xffffffff;
+	// r can be the result of a previous call to continue a checksum over more data.
+	uint32_t operator()(const uint8_t* data, size_t data_size, uint32_t r = 0xffffffff) {
 		const uint8_t* end = data + data_size;
 		for (; data != end; ++data) {
 			r = (r >> 8) ^ table[(r ^ *data) & 0xff];
@@ -81,8 +81,98 @@ auto make_replay_file_reader(base_reader_T& reader) {
 
 }
 
+// A single file holding the decompressed sections of many replays, with each distinct
+// map stored only once. Replays are read straight out of the (memory mapped) file.
+// Written by replay_pack_writer (replay_pack.h).
+//
+// All values are little endian.
+// header:
+//   uint32_t identifier ('OBRP')
+//   uint32_t version
+//   uint32_t replay count
+//   uint32_t map count
+//   uint64_t index offset
+// followed by the data the index refers to, and at the index offset:
+//   for each map: uint64_t offset, uint64_t size
+//   for each replay: uint64_t game info offset (633 bytes), uint64_t actions offset,
+//                    uint32_t actions size, uint32_t map index
+struct replay_pack {
+	static const uint32_t identifier = 0x5052424f;
+	static const uint32_t version = 1;
+	static const size_t header_size = 24;
+	static const size_t map_entry_size = 16;
+	static const size_t replay_entry_size = 24;
+	
+	data_loading::mapped_file file;
+	size_t replay_count = 0;
+	size_t map_count = 0;
+	const uint8_t* map_index = nullptr;
+	const uint8_t* replay_index = nullptr;
+	
+	replay_pack() = default;
+	explicit replay_pack(a_string filename) {
+		open(std::move(filename));
+	}
+	
+	void open(a_string filename) {
+		file.open(std::move(filename));
+		data_loading::data_reader_le r(file.data(), file.data() + file.size());
+		if (r.get<uint32_t>() != identifier) error("replay_pack: %s: invalid identifier", file.filename);
+		uint32_t file_version = r.get<uint32_t>();
+		if (file_version != version) error("replay_pack: %s: unsupported version %d", file.filename, file_version);
+		replay_count = r.get<uint32_t>();
+		map_count = r.get<uint32_t>();
+		size_t index_offset = (size_t)r.get<uint64_t>();
+		r.seek(index_offset);
+		map_index = r.get_n(map_count * map_entry_size);
+		replay_index = r.get_n(replay_count * replay_entry_size);
+	}
+	
+	size_t size() const {
+		return replay_count;
+	}
+	
+	struct entry_t {
+		const uint8_t* game_info;
+		const uint8_t* actions_data;
+		size_t actions_data_size;
+		const uint8_t* map_data;
+		size_t map_data_size;
+		size_t map_index;
+	};
+	
+	entry_t get(size_t index) const {
+		if (index >= replay_count) error("replay_pack: replay index %d out of range", index);
+		data_loading::data_reader_le r(replay_index + index * replay_entry_size, replay_index + (index + 1) * replay_entry_size);
+		size_t game_info_offset = (size_t)r.get<uint64_t>();
+		size_t actions_offset = (size_t)r.get<uint64_t>();
+		size_t actions_size = r.get<uint32_t>();
+		size_t map_n = r.get<uint32_t>();
+		if (map_n >= map_count) error("replay_pack: map index %d out of range", map_n);
+		data_loading::data_reader_le mr(map_index + map_n * map_entry_size, map_index + (map_n + 1) * map_entry_size);
+		size_t map_offset = (size_t)mr.get<uint64_t>();
+		size_t map_size = (size_t)mr.get<uint64_t>();
+		
+		data_loading::data_reader_le fr(file.data(), file.data() + file.size());
+		entry_t e;
+		fr.seek(game_info_offset);
+		e.game_info = fr.get_n(633);
+		fr.seek(actions_offset);
+		e.actions_data = fr.get_n(actions_size);
+		e.actions_data_size = actions_size;
+		fr.seek(map_offset);
+		e.map_data = fr.get_n(map_size);
+		e.map_data_size = map_size;
+		e.map_index = map_n;
+		return e;
+	}
+};
+
 struct replay_state {
 	a_vector<uint8_t> actions_data_buffer;
+	// Set by replay_functions::decode_actions. Shared, so copies of a replay_state
+	// do not need to decode again.
+	std::shared_ptr<const decoded_actions_t> decoded_actions;
 	int end_frame = 0;
 	a_string map_name;
 	std::array<a_string, 12> player_name;
@@ -110,7 +200,29 @@ struct replay_functions: action_functions {
 		std::array<uint8_t, 633> game_info_buffer;
 		r.get_bytes(game_info_buffer.data(), game_info_buffer.size());
 		
-		data_loading::data_reader_le gir(game_info_buffer.data(), game_info_buffer.data() + game_info_buffer.size());
+		a_vector<uint8_t> actions_data_buffer;
+		actions_data_buffer.resize(r.template get<uint32_t>());
+		r.get_bytes(actions_data_buffer.data(), actions_data_buffer.size());
+		
+		a_vector<uint8_t> map_buffer;
+		map_buffer.resize(r.template get<uint32_t>());
+		r.get_bytes(map_buffer.data(), map_buffer.size());
+
+		if (get_map_data) get_map_data->assign(map_buffer.begin(), map_buffer.end());
+		
+		load_replay_sections(game_info_buffer.data(), std::move(actions_data_buffer), map_buffer.data(), map_buffer.size(), initial_processing);
+	}
+	
+	void load_replay_from_pack(const replay_pack& pack, size_t index, bool initial_processing = true) {
+		auto e = pack.get(index);
+		a_vector<uint8_t> actions_data_buffer(e.actions_data, e.actions_data + e.actions_data_size);
+		load_replay_sections(e.game_info, std::move(actions_data_buffer), e.map_data, e.map_data_size, initial_processing);
+	}
+	
+	// Loads a replay from its decompressed sections. game_info points to the 633 bytes of the game info section.
+	void load_replay_sections(const uint8_t* game_info, a_vector<uint8_t> actions_data_buffer, const uint8_t* map_data, size_t map_data_size, bool initial_processing = true) {
+		
+		data_loading::data_reader_le gir(game_info, game_info + 633);
 		
 		gir.get<uint8_t>(); // is broodwar
 		auto frame_count = gir.get<uint32_t>();
@@ -193,17 +305,11 @@ struct replay_functions: action_functions {
 		replay_st.end_frame = frame_count;
 		replay_st.game_type = game_type;
 		
-		replay_st.actions_data_buffer.resize(r.template get<uint32_t>());
-		r.get_bytes(replay_st.actions_data_buffer.data(), replay_st.actions_data_buffer.size());
-		
-		a_vector<uint8_t> map_buffer;
-		map_buffer.resize(r.template get<uint32_t>());
-		r.get_bytes(map_buffer.data(), map_buffer.size());
-
-		if (get_map_data) *get_map_data = map_buffer;
+		replay_st.decoded_actions = nullptr;
+		replay_st.actions_data_buffer = std::move(actions_data_buffer);
 		
 		game_load_functions game_load_funcs(st);
-		game_load_funcs.load_map_data(map_buffer.data(), map_buffer.size(), [&]() {
+		game_load_funcs.load_map_data(map_data, map_data_size, [&]() {
 			game_load_funcs.setup_info.victory_condition = victory_condition;
 			game_load_funcs.setup_info.starting_units = create_initial_units;
 			game_load_funcs.setup_info.tournament_mode = tournament_mode;
@@ -230,9 +336,19 @@ struct replay_functions: action_functions {
 		}
 	}
 	
+	// Parses all the actions once, so that next_frame does not need to.
+	// Useful when the replay will be played more than once, eg. when seeking.
+	// Malformed action data is reported here, and decoded_actions is then left unset, so
+	// the replay can still be played from the raw data up to the malformed action.
+	void decode_actions() {
+		auto begin = replay_st.actions_data_buffer.data();
+		replay_st.decoded_actions = std::make_shared<decoded_actions_t>(action_functions::decode_actions(begin, begin + replay_st.actions_data_buffer.size()));
+	}
+	
 	void next_frame() {
 		if (st.current_frame == replay_st.end_frame) error("replay: attempt to play past end");
-		execute_actions(replay_st.actions_data_buffer.data(), replay_st.actions_data_buffer.data() + replay_st.actions_data_buffer.size());
+		if (replay_st.decoded_actions) execute_decoded_actions(*replay_st.decoded_actions);
+		else execute_actions(replay_st.actions_data_buffer.data(), replay_st.actions_data_buffer.data() + replay_st.actions_data_buffer.size());
 		state_functions::next_frame();
 	}
 	
@@ -0,0 +1,131 @@
+#ifndef BWGAME_REPLAY_PACK_H
+#define BWGAME_REPLAY_PACK_H
+
+#include "replay.h"
+#include "replay_saver.h"
+
+namespace bwgame {
+
+// Builds a replay_pack (see replay.h) out of any number of replay files.
+// Call finish once all replays have been added; the pack is not valid before that.
+struct replay_pack_writer {
+	struct map_entry_t {
+		uint64_t offset;
+		uint64_t size;
+	};
+	struct replay_entry_t {
+		uint64_t game_info_offset;
+		uint64_t actions_offset;
+		uint32_t actions_size;
+		uint32_t map_index;
+	};
+
+	data_loading::file_writer<> w;
+	a_vector<map_entry_t> maps;
+	// Maps are written out as soon as they are first seen, and only their hashes are
+	// kept. Two maps are taken to be the same if their sizes and both hashes match.
+	a_vector<uint64_t> map_check_hashes;
+	a_vector<replay_entry_t> replays;
+	a_unordered_multimap<uint64_t, size_t> map_hashes;
+
+	explicit replay_pack_writer(a_string filename) : w(std::move(filename)) {
+		std::array<uint8_t, replay_pack::header_size> header{};
+		w.put_bytes(header.data(), header.size());
+	}
+
+	void add_replay_file(a_string filename) {
+		data_loading::file_reader<> file_r(std::move(filename));
+		add_replay(data_loading::make_replay_file_reader(file_r));
+	}
+
+	void add_replay_data(const uint8_t* data, size_t data_size) {
+		data_loading::data_reader_le r(data, data + data_size);
+		add_replay(data_loading::make_replay_file_reader(r));
+	}
+
+	template<typename reader_T>
+	void add_replay(reader_T&& r) {
+		uint32_t identifier = r.template get<uint32_t>();
+		if (identifier != 0x53526572) error("replay_pack_writer: invalid identifier %#x", identifier);
+
+		std::array<uint8_t, 633> game_info_buffer;
+		r.get_bytes(game_info_buffer.data(), game_info_buffer.size());
+
+		a_vector<uint8_t> actions_data_buffer;
+		actions_data_buffer.resize(r.template get<uint32_t>());
+		r.get_bytes(actions_data_buffer.data(), actions_data_buffer.size());
+
+		a_vector<uint8_t> map_buffer;
+		map_buffer.resize(r.template get<uint32_t>());
+		r.get_bytes(map_buffer.data(), map_buffer.size());
+
+		replay_entry_t e;
+		e.map_index = (uint32_t)add_map(map_buffer);
+		e.game_info_offset = w.tell();
+		w.put_bytes(game_info_buffer.data(), game_info_buffer.size());
+		e.actions_offset = w.tell();
+		e.actions_size = (uint32_t)actions_data_buffer.size();
+		w.put_bytes(actions_data_buffer.data(), actions_data_buffer.size());
+		replays.push_back(e);
+	}
+
+	void finish() {
+		uint64_t index_offset = w.tell();
+		for (auto& v : maps) {
+			w.put<uint64_t>(v.offset);
+			w.put<uint64_t>(v.size);
+		}
+		for (auto& v : replays) {
+			w.put<uint64_t>(v.game_info_offset);
+			w.put<uint64_t>(v.actions_offset);
+			w.put<uint32_t>(v.actions_size);
+			w.put<uint32_t>(v.map_index);
+		}
+		w.seek(0);
+		w.put<uint32_t>(replay_pack::identifier);
+		w.put<uint32_t>(replay_pack::version);
+		w.put<uint32_t>((uint32_t)replays.size());
+		w.put<uint32_t>((uint32_t)maps.size());
+		w.put<uint64_t>(index_offset);
+		w.flush();
+	}
+
+private:
+	static uint64_t map_hash(const a_vector<uint8_t>& data) {
+		uint64_t r = 0xcbf29ce484222325;
+		for (uint8_t v : data) {
+			r ^= v;
+			r *= 0x100000001b3;
+		}
+		return r ^ data.size();
+	}
+
+	// Unrelated to map_hash, so that both colliding is not a concern.
+	static uint64_t map_check_hash(const a_vector<uint8_t>& data) {
+		uint64_t r = data.size();
+		for (uint8_t v : data) {
+			r = (r + v) * 0x9e3779b97f4a7c15;
+			r ^= r >> 29;
+		}
+		return r;
+	}
+
+	size_t add_map(const a_vector<uint8_t>& data) {
+		uint64_t hash = map_hash(data);
+		uint64_t check_hash = map_check_hash(data);
+		auto range = map_hashes.equal_range(hash);
+		for (auto i = range.first; i != range.second; ++i) {
+			if (maps[i->second].size == data.size() && map_check_hashes[i->second] == check_hash) return i->second;
+		}
+		size_t index = maps.size();
+		maps.push_back({w.tell(), data.size()});
+		w.put_bytes(data.data(), data.size());
+		map_check_hashes.push_back(check_hash);
+		map_hashes.emplace(hash, index);
+		return index;
+	}
+};
+
+}
+
+#endif
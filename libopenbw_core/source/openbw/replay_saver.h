@@ -3,6 +3,9 @@
 
 #include "bwgame.h"
 #include "replay.h"
+#include "thread_pool.h"
+
+#include <future>
 
 namespace bwgame {
 
@@ -406,7 +409,8 @@ template<typename base_writer_T, bool default_little_endian = true>
 struct replay_file_writer {
 	crc32_t crc32;
 	base_writer_T& w;
-	replay_file_writer(base_writer_T& w) : w(w) {
+	thread_pool* pool = nullptr;
+	replay_file_writer(base_writer_T& w, thread_pool* pool = nullptr) : w(w), pool(pool) {
 	}
 	template<typename T, bool little_endian = default_little_endian>
 	void put(T v) {
@@ -418,25 +422,45 @@ struct replay_file_writer {
 		size_t segments = (size + 8191) / 8192;
 		w.template put<uint32_t>(segments);
 		
-		a_vector<uint8_t> compressed_data;
-		
-		size_t output_pos = 0;
-		for (size_t i = 0; i != segments; ++i) {
-			size_t segment_output_size = size - output_pos;
-			if (segment_output_size > 8192) segment_output_size = 8192;
-			
+		auto segment_output_size = [&](size_t i) {
+			return std::min(size - i * 8192, (size_t)8192);
+		};
+		auto compress_segment = [&](size_t i, a_vector<uint8_t>& compressed_data) {
+			size_t n = segment_output_size(i);
 			compressed_data.clear();
-			compressed_data.reserve(4 + 4 + segment_output_size + (segment_output_size - 1) / 2);
+			compressed_data.reserve(4 + 4 + n + (n - 1) / 2);
 			auto cw = data_loading::make_vector_writer(compressed_data);
-			data_loading::compress(data + output_pos, segment_output_size, cw);
-			if (compressed_data.size() < segment_output_size) {
+			data_loading::compress(data + i * 8192, n, cw);
+		};
+		auto put_segment = [&](size_t i, const a_vector<uint8_t>& compressed_data) {
+			size_t n = segment_output_size(i);
+			if (compressed_data.size() < n) {
 				w.template put<uint32_t>(compressed_data.size());
 				w.put_bytes(compressed_data.data(), compressed_data.size());
-			} else {	
-				w.template put<uint32_t>(segment_output_size);
-				w.put_bytes(data + output_pos, segment_output_size);
+			} else {
+				w.template put<uint32_t>(n);
+				w.put_bytes(data + i * 8192, n);
+			}
+			return n;
+		};
+		
+		size_t output_pos = 0;
+		if (pool && segments > 1) {
+			// Segments are compressed independently, so they can be done in any order
+			// as long as they are written out in order.
+			a_vector<a_vector<uint8_t>> compressed_segments(segments);
+			pool->parallel_for(segments, [&](size_t i) {
+				compress_segment(i, compressed_segments[i]);
+			});
+			for (size_t i = 0; i != segments; ++i) {
+				output_pos += put_segment(i, compressed_segments[i]);
+			}
+		} else {
+			a_vector<uint8_t> compressed_data;
+			for (size_t i = 0; i != segments; ++i) {
+				compress_segment(i, compressed_data);
+				output_pos += put_segment(i, compressed_data);
 			}
-			output_pos += segment_output_size;
 		}
 		
 		if (output_pos != size) error("replay_file_writer: wrote %d bytes, expected %d", output_pos, size);
@@ -444,68 +468,10 @@ struct replay_file_writer {
 };
 
 template<typename base_writer_T>
-auto make_replay_file_writer(base_writer_T& writer) {
-	return replay_file_writer<base_writer_T>(writer);
+auto make_replay_file_writer(base_writer_T& writer, thread_pool* pool = nullptr) {
+	return replay_file_writer<base_writer_T>(writer, pool);
 }
 
-template<bool default_little_endian = true>
-struct file_writer {
-	a_string filename;
-	FILE* f = nullptr;
-	file_writer() = default;
-	explicit file_writer(a_string filename) {
-		open(std::move(filename));
-	}
-	~file_writer() {
-		if (f) fclose(f);
-	}
-	file_writer(const file_writer&) = delete;
-	file_writer(file_writer&& n) {
-		f = n.f;
-		n.f = nullptr;
-	}
-	file_writer& operator=(const file_writer&) = delete;
-	file_writer& operator=(file_writer&& n) {
-		std::swap(f, n.f);
-		return *this;
-	}
-	void open(a_string filename) {
-		if (f) fclose(f);
-		f = fopen(filename.c_str(), "wb");
-		if (!f) error("file_writer: failed to open %s for writing", filename.c_str());
-		this->filename = std::move(filename);
-	}
-	void put_bytes(const uint8_t* src, size_t n) {
-		if (!fwrite(src, n, 1, f)) {
-			error("file_writer: %s: write error", filename);
-		}
-	}
-	template<typename T, bool little_endian = default_little_endian>
-	void put(T v) {
-		static_assert(std::is_integral<T>::value, "data_writer: don't know how to write this type");
-		put_bytes((const uint8_t*)&v, sizeof(v));
-	}
-	void seek(size_t offset) {
-		if ((size_t)(long)offset != offset || fseek(f, (long)offset, SEEK_SET)) error("file_writer: %s: failed to seek to offset %d", filename, offset);
-	}
-	bool eof() {
-		return feof(f);
-	}
-	size_t left() const {
-		return size() - tell();
-	}
-	size_t tell() const {
-		return (size_t)ftell(f);
-	}
-	size_t size() {
-		auto prev_pos = ftell(f);
-		fseek(f, 0, SEEK_END);
-		auto r = ftell(f);
-		fseek(f, prev_pos, SEEK_SET);
-		return r;
-	}
-};
-
 }
 
 struct replay_saver_state {
@@ -559,8 +525,7 @@ struct replay_saver_functions {
 		w.put_bytes(data, data_size);
 	}
 	
-	template<typename writer_T>
-	void save_replay(int current_frame, writer_T& w) {
+	std::array<uint8_t, 633> make_game_info(int current_frame) const {
 		std::array<uint8_t, 633> game_info_buffer;
 		data_loading::data_writer<> giw(game_info_buffer.data(), game_info_buffer.data() + game_info_buffer.size());
 		
@@ -628,20 +593,48 @@ struct replay_saver_functions {
 		for (size_t i = 0; i != 8; ++i) {
 			giw.put<uint8_t>(0); // create_melee_units_for_player
 		}
+		return game_info_buffer;
+	}
+	
+	size_t history_size() const {
+		if (replay_saver_st.history.empty()) return 0;
+		return (replay_saver_st.history.size() - 1) * replay_saver_st.history.back().capacity() + replay_saver_st.history.back().size();
+	}
+	
+	// The size of the prefix of history that further calls to add_action will not modify.
+	// Only the size byte of the last frame block is ever patched after being written.
+	size_t final_history_size() const {
+		if (replay_saver_st.current_history_frame == -1) return history_size();
+		return replay_saver_st.current_actions_size_index * replay_saver_st.history.back().capacity() + replay_saver_st.current_actions_size_offset - 4;
+	}
+	
+	void copy_history(size_t begin, size_t end, a_vector<uint8_t>& dst) const {
+		size_t buffer_size = replay_saver_st.history.empty() ? 0 : replay_saver_st.history.back().capacity();
+		while (begin != end) {
+			auto& buf = replay_saver_st.history.at(begin / buffer_size);
+			size_t offset = begin % buffer_size;
+			size_t n = std::min(end - begin, buf.size() - offset);
+			dst.insert(dst.end(), buf.begin() + offset, buf.begin() + offset + n);
+			begin += n;
+		}
+	}
+	
+	// If pool is not null, the compression of each section is spread across its threads.
+	// The output is identical either way.
+	template<typename writer_T>
+	void save_replay(int current_frame, writer_T& w, thread_pool* pool = nullptr) {
+		auto game_info_buffer = make_game_info(current_frame);
 		
-		auto rw = data_loading::make_replay_file_writer(w);
+		auto rw = data_loading::make_replay_file_writer(w, pool);
 		
 		rw.template put<uint32_t>(0x53526572);
 		rw.put_bytes(game_info_buffer.data(), game_info_buffer.size());
 		
-		size_t history_size = 0;
-		for (auto& v : replay_saver_st.history) history_size += v.size();
+		size_t history_size = this->history_size();
 		rw.template put<uint32_t>(history_size);
 		a_vector<uint8_t> tmp_buf;
 		tmp_buf.reserve(history_size);
-		for (auto& v : replay_saver_st.history) {
-			tmp_buf.insert(tmp_buf.end(), v.begin(), v.end());
-		}
+		copy_history(0, history_size, tmp_buf);
 		rw.put_bytes(tmp_buf.data(), tmp_buf.size());
 		
 		if (!replay_saver_st.map_data) error("replay_saver_functions::save_replay: replay_saver_state::map_data is null");
@@ -652,6 +645,164 @@ struct replay_saver_functions {
 };
 
 
+// Writes a replay file incrementally while the game is running. Every call to checkpoint
+// hands the actions recorded since the previous checkpoint to a background thread, which
+// appends them to the file and patches the header, so that the file on disk is a complete,
+// loadable replay up to that frame (apart from the short window while a checkpoint is
+// being written).
+//
+// File layout: the identifier, game info and actions size sections are always stored
+// uncompressed so they have a fixed size and can be rewritten in place. The actions section
+// follows, with its completed 8192-byte segments written once. The trailing partial segment
+// and the (precompressed) map sections after it are rewritten at each checkpoint.
+struct replay_stream_writer {
+	replay_saver_state& replay_saver_st;
+	
+	std::mutex error_mut;
+	std::exception_ptr worker_error;
+	size_t submitted_size = 0;
+	
+	// Only accessed by the worker thread after construction.
+	data_loading::file_writer<> w;
+	data_loading::crc32_t crc32;
+	a_vector<uint8_t> map_sections;
+	a_vector<uint8_t> pending;
+	a_vector<uint8_t> compressed_data;
+	uint32_t actions_crc32 = 0xffffffff;
+	size_t actions_size = 0;
+	size_t actions_segments = 0;
+	size_t tail_pos = 0;
+	
+	// Declared last so that it is joined before anything it uses is destroyed.
+	thread_pool worker{1};
+	
+	static constexpr size_t game_info_pos = 16;
+	static constexpr size_t actions_size_pos = game_info_pos + 12 + 633;
+	static constexpr size_t actions_pos = actions_size_pos + 16;
+	
+	replay_stream_writer(replay_saver_state& replay_saver_st, a_string filename) : replay_saver_st(replay_saver_st), w(std::move(filename)) {
+		if (!replay_saver_st.map_data) error("replay_stream_writer: replay_saver_state::map_data is null");
+		auto mw = data_loading::make_vector_writer(map_sections);
+		map_sections.reserve(4 + 4 + 4 + 4 + 4 + 4 + replay_saver_st.map_data_size + replay_saver_st.map_data_size / 2 + 0x1000);
+		auto rw = data_loading::make_replay_file_writer(mw);
+		rw.template put<uint32_t>(replay_saver_st.map_data_size);
+		rw.put_bytes(replay_saver_st.map_data, replay_saver_st.map_data_size);
+		
+		uint32_t identifier = 0x53526572;
+		put_raw_section((const uint8_t*)&identifier, 4);
+		tail_pos = actions_pos + 8;
+		write_checkpoint({}, replay_saver_functions(replay_saver_st).make_game_info(0));
+	}
+	~replay_stream_writer() {
+		// Let queued checkpoints finish; errors can no longer be reported at this point.
+		try {
+			wait();
+		} catch (const std::exception&) {
+		}
+	}
+	
+	// current_frame is the number of frames that have been played. Actions recorded for
+	// a frame that is not over yet are left for the next checkpoint, and the replay then
+	// ends at the start of that frame.
+	void checkpoint(int current_frame) {
+		replay_saver_functions funcs(replay_saver_st);
+		int last_frame = replay_saver_st.current_history_frame;
+		if (last_frame != -1 && last_frame >= current_frame) submit(funcs, funcs.final_history_size(), last_frame);
+		else submit(funcs, funcs.history_size(), current_frame);
+	}
+	
+	// Writes everything recorded so far and waits for it to reach the file.
+	void finish(int current_frame) {
+		replay_saver_functions funcs(replay_saver_st);
+		submit(funcs, funcs.history_size(), current_frame);
+		wait();
+	}
+	
+	void wait() {
+		std::promise<void> done;
+		auto f = done.get_future();
+		worker.post([&done]() {
+			done.set_value();
+		});
+		f.wait();
+		rethrow_worker_error();
+	}
+	
+private:
+	void rethrow_worker_error() {
+		std::lock_guard<std::mutex> l(error_mut);
+		if (worker_error) std::rethrow_exception(worker_error);
+	}
+	
+	void submit(replay_saver_functions& funcs, size_t end, int current_frame) {
+		rethrow_worker_error();
+		a_vector<uint8_t> data;
+		if (end > submitted_size) {
+			data.reserve(end - submitted_size);
+			funcs.copy_history(submitted_size, end, data);
+			submitted_size = end;
+		}
+		worker.post([this, data = std::move(data), game_info = funcs.make_game_info(current_frame)]() {
+			try {
+				write_checkpoint(data, game_info);
+			} catch (...) {
+				std::lock_guard<std::mutex> l(error_mut);
+				if (!worker_error) worker_error = std::current_exception();
+			}
+		});
+	}
+	
+	void put_raw_section(const uint8_t* data, size_t size) {
+		w.template put<uint32_t>(crc32(data, size));
+		w.template put<uint32_t>(1);
+		w.template put<uint32_t>(size);
+		w.put_bytes(data, size);
+	}
+	
+	void put_segment(const uint8_t* data, size_t size) {
+		compressed_data.clear();
+		compressed_data.reserve(4 + 4 + size + (size - 1) / 2);
+		auto cw = data_loading::make_vector_writer(compressed_data);
+		data_loading::compress(data, size, cw);
+		if (compressed_data.size() < size) {
+			w.template put<uint32_t>(compressed_data.size());
+			w.put_bytes(compressed_data.data(), compressed_data.size());
+		} else {
+			w.template put<uint32_t>(size);
+			w.put_bytes(data, size);
+		}
+	}
+	
+	void write_checkpoint(const a_vector<uint8_t>& data, const std::array<uint8_t, 633>& game_info) {
+		actions_crc32 = crc32(data.data(), data.size(), actions_crc32);
+		actions_size += data.size();
+		pending.insert(pending.end(), data.begin(), data.end());
+		
+		w.seek(tail_pos);
+		size_t pending_pos = 0;
+		for (; pending.size() - pending_pos >= 8192; pending_pos += 8192) {
+			put_segment(pending.data() + pending_pos, 8192);
+			++actions_segments;
+		}
+		pending.erase(pending.begin(), pending.begin() + pending_pos);
+		tail_pos = w.tell();
+		if (!pending.empty()) put_segment(pending.data(), pending.size());
+		w.put_bytes(map_sections.data(), map_sections.size());
+		// The tail segment may have compressed to fewer bytes than last time.
+		w.truncate(w.tell());
+		
+		w.seek(actions_pos);
+		w.template put<uint32_t>(actions_crc32);
+		w.template put<uint32_t>(actions_segments + (pending.empty() ? 0 : 1));
+		w.seek(actions_size_pos);
+		uint32_t actions_size_value = (uint32_t)actions_size;
+		put_raw_section((const uint8_t*)&actions_size_value, 4);
+		w.seek(game_info_pos);
+		put_raw_section(game_info.data(), game_info.size());
+		w.flush();
+	}
+};
+
 }
 
 #endif
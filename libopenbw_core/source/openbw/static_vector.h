@@ -431,6 +431,24 @@ public:
 		m_destroy(ptr_end() - 1);
 		--m_end;
 	}
+	iterator insert(const iterator pos, const T& value) {
+		return insert(pos, T(value));
+	}
+	iterator insert(const iterator pos, T&& value) {
+		if (size() == capacity()) throw std::length_error("static_vector resized beyond capacity");
+		if (pos.ptr == m_end) {
+			new (ptr_end()) value_type(std::move(value));
+			m_end = ptr_end() + 1;
+			return pos;
+		}
+		new (ptr_end()) value_type(std::move(*(ptr_end() - 1)));
+		for (pointer i = ptr_end() - 1; i != pos.ptr; --i) {
+			*i = std::move(*(i - 1));
+		}
+		m_end = ptr_end() + 1;
+		*pos.ptr = std::move(value);
+		return pos;
+	}
 	iterator erase(const iterator pos) {
 		for (pointer i = pos.ptr;;) {
 			pointer ni = i + 1;
@@ -0,0 +1,129 @@
+#ifndef BWGAME_THREAD_POOL_H
+#define BWGAME_THREAD_POOL_H
+
+#include "containers.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <exception>
+#include <algorithm>
+
+namespace bwgame {
+
+// A fixed set of worker threads. One pool can be shared by any number of games/loaders;
+// nothing in here touches game state, so determinism is up to the caller.
+struct thread_pool {
+	a_vector<std::thread> threads;
+	a_deque<std::function<void()>> queue;
+	std::mutex mut;
+	std::condition_variable cv;
+	bool stopping = false;
+
+	explicit thread_pool(size_t thread_count = std::thread::hardware_concurrency()) {
+		if (thread_count == 0) thread_count = 1;
+		threads.reserve(thread_count);
+		for (size_t i = 0; i != thread_count; ++i) {
+			threads.emplace_back([this]() {
+				worker();
+			});
+		}
+	}
+	~thread_pool() {
+		{
+			std::lock_guard<std::mutex> l(mut);
+			stopping = true;
+		}
+		cv.notify_all();
+		for (auto& v : threads) v.join();
+	}
+	thread_pool(const thread_pool&) = delete;
+	thread_pool& operator=(const thread_pool&) = delete;
+
+	size_t size() const {
+		return threads.size();
+	}
+
+	template<typename F>
+	void post(F&& f) {
+		{
+			std::lock_guard<std::mutex> l(mut);
+			queue.emplace_back(std::forward<F>(f));
+		}
+		cv.notify_one();
+	}
+
+	// Calls f(i) for every i in [0, n) and returns when all calls have finished.
+	// The calling thread takes part in the work, so this may also be called from
+	// inside a pool task without deadlocking. The first exception thrown by f is
+	// rethrown here.
+	template<typename F>
+	void parallel_for(size_t n, F&& f) {
+		if (n == 0) return;
+		if (n == 1) {
+			f((size_t)0);
+			return;
+		}
+		struct batch_t {
+			std::atomic<size_t> next{0};
+			size_t done = 0;
+			size_t n;
+			std::exception_ptr exception;
+			std::mutex mut;
+			std::condition_variable cv;
+			std::function<void(size_t)> f;
+		};
+		auto batch = std::make_shared<batch_t>();
+		batch->n = n;
+		batch->f = std::ref(f);
+		auto run = [batch]() {
+			while (true) {
+				size_t i = batch->next++;
+				if (i >= batch->n) return;
+				std::exception_ptr e;
+				try {
+					batch->f(i);
+				} catch (...) {
+					e = std::current_exception();
+				}
+				std::lock_guard<std::mutex> l(batch->mut);
+				if (e && !batch->exception) batch->exception = e;
+				if (++batch->done == batch->n) batch->cv.notify_all();
+			}
+		};
+		size_t helpers = std::min(n - 1, threads.size());
+		for (size_t i = 0; i != helpers; ++i) post(run);
+		run();
+		std::unique_lock<std::mutex> l(batch->mut);
+		batch->cv.wait(l, [&]() {
+			return batch->done == batch->n;
+		});
+		// Queued helpers that have not started yet may still hold a reference to the batch,
+		// but they will find no work left and never call f.
+		batch->f = nullptr;
+		if (batch->exception) std::rethrow_exception(batch->exception);
+	}
+
+private:
+	void worker() {
+		while (true) {
+			std::function<void()> f;
+			{
+				std::unique_lock<std::mutex> l(mut);
+				cv.wait(l, [&]() {
+					return stopping || !queue.empty();
+				});
+				if (queue.empty()) return;
+				f = std::move(queue.front());
+				queue.pop_front();
+			}
+			f();
+		}
+	}
+};
+
+}
+
+#endif
@@ -343,7 +343,7 @@ void draw_frame(const grp_t::frame_t& frame, const uint8_t* texture, uint8_t* ds
 		if (flipped) dst += frame.size.x - 1;
 		if (textured && flipped) texture += frame.size.x - 1;
 
-		const uint8_t* d = frame.data_container.data() + frame.line_data_offset.at(y);
+		const uint8_t* d = frame.line_data(y);
 		for (size_t x = flipped ? frame.size.x - 1 : 0; x != (flipped ? (size_t)0 - 1 : frame.size.x);) {
 			int v = *d++;
 			if (v & 0x80) {
@@ -833,7 +833,7 @@ struct ui_functions: ui_util_functions {
 
 		if (screen_x >= (int)draw_size.x() || screen_y >= (int)draw_size.y()) return;
 
-		auto& frame = image->grp->frames.at(image->frame_index);
+		auto& frame = grp_frame(*image->grp, image->frame_index);
 
 		size_t width = frame.size.x;
 		size_t height = frame.size.y;
@@ -912,7 +912,7 @@ struct ui_functions: ui_util_functions {
 			draw_alpha(image->image_type->color_shift - 1, no_remap());
 		} else if (image->modifier == 12) {
 			if (temporary_warp_texture_buffer.size() < frame.size.x * frame.size.y) temporary_warp_texture_buffer.resize(frame.size.x * frame.size.y);
-			auto& texture_frame = global_st.image_grp[(size_t)ImageTypes::IMAGEID_Warp_Texture]->frames.at(image->modifier_data1);
+			auto& texture_frame = grp_frame(*global_st.image_grp[(size_t)ImageTypes::IMAGEID_Warp_Texture], image->modifier_data1);
 			draw_frame(texture_frame, false, temporary_warp_texture_buffer.data(), frame.size.x, 0, 0, frame.size.x, frame.size.y);
 			draw_frame_textured(frame, temporary_warp_texture_buffer.data(), i_flag(image, image_t::flag_horizontally_flipped), dst, data_pitch, offset_x, offset_y, width, height);
 		} else if (image->modifier == 17) {
@@ -928,7 +928,8 @@ struct ui_functions: ui_util_functions {
 
 	}
 
-	a_vector<const unit_t*> current_selection_sprites_set = a_vector<const unit_t*>(2500);
+	// Indexed by sprite index. Sized in draw_sprites, since the sprite limit belongs to the state.
+	a_vector<const unit_t*> current_selection_sprites_set;
 	a_vector<const sprite_t*> current_selection_sprites;
 
 	void draw_selection_circle(const sprite_t* sprite, const unit_t* u, uint8_t* data, size_t data_pitch) {
@@ -937,7 +938,7 @@ struct ui_functions: ui_util_functions {
 		xy map_pos = sprite->position + xy(0, sprite->sprite_type->selection_circle_vpos);
 
 		auto* grp = global_st.image_grp[(size_t)image_type->id];
-		auto& frame = grp->frames.at(0);
+		auto& frame = grp_frame(*grp, 0);
 
 		map_pos.x += int(frame.offset.x - grp->width / 2);
 		map_pos.y += int(frame.offset.y - grp->height / 2);
@@ -1194,6 +1195,11 @@ struct ui_functions: ui_util_functions {
 
 		std::sort(sorted_sprites.begin(), sorted_sprites.end());
 
+		// All entries are null between calls, so this only has to follow the state's sprite limit.
+		if (current_selection_sprites_set.size() != st.sprites_container.max_size) {
+			current_selection_sprites_set.resize(st.sprites_container.max_size);
+		}
+
 		if(user_input)
 		{
 			for (auto u : actions_proxy->selected_units(user_input->owner)) {
@@ -1573,16 +1579,16 @@ struct ui_functions: ui_util_functions {
 		indexed_surface = bwgame::resize(indexed_surface, draw_size);
 	}
 
-	a_vector<unit_id> current_selection;
+	a_vector<unit_id_32> current_selection;
 
 	bool current_selection_is_selected(unit_t* u) {
-		auto uid = get_unit_id(u);
+		auto uid = get_unit_id_32(u);
 		return std::find(current_selection.begin(), current_selection.end(), uid) != current_selection.end();
 	}
 
 	void current_selection_add(unit_t* u) {
 
-		auto uid = get_unit_id(u);
+		auto uid = get_unit_id_32(u);
 		if (current_selection.size() == 12 || std::find(current_selection.begin(), current_selection.end(), uid) != current_selection.end()) return;
 		current_selection.push_back(uid);
 		temp_selected_unit_buffer.push_back(u);
@@ -1593,7 +1599,7 @@ struct ui_functions: ui_util_functions {
 	}
 
 	void current_selection_remove(const unit_t* u) {
-		auto uid = get_unit_id(u);
+		auto uid = get_unit_id_32(u);
 		auto i = std::find(current_selection.begin(), current_selection.end(), uid);
 		if (i != current_selection.end())
 		{
@@ -0,0 +1,45 @@
+#include "openbw/replay_pack.h"
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+using namespace bwgame;
+
+int main(int argc, char const* argv[])
+{
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s <output pack> <replay files...>\n", argv[0]);
+		fprintf(stderr, "       %s <output pack> - (read replay filenames from stdin)\n", argv[0]);
+		return 1;
+	}
+
+	replay_pack_writer w(argv[1]);
+
+	size_t failed = 0;
+	auto add = [&](a_string filename) {
+		try {
+			w.add_replay_file(filename);
+		} catch (const std::exception& e) {
+			fprintf(stderr, "%s: %s\n", filename.c_str(), e.what());
+			++failed;
+		}
+	};
+
+	if (argc == 3 && argv[2] == a_string("-")) {
+		std::string line;
+		while (std::getline(std::cin, line)) {
+			if (!line.empty()) add(a_string(line.begin(), line.end()));
+		}
+	} else {
+		for (int i = 2; i != argc; ++i) add(argv[i]);
+	}
+
+	w.finish();
+
+	printf("packed %d replays with %d distinct maps", (int)w.replays.size(), (int)w.maps.size());
+	if (failed) printf(", %d failed", (int)failed);
+	printf("\n");
+
+	return failed ? 2 : 0;
+}
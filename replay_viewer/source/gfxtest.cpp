@@ -55,6 +55,16 @@ struct main_t {
 
 	main_t(game_player player) : ui(std::move(player), int2(1280,800), true) {}
 
+	// Decoding only speeds up seeking. If an action can not be decoded, the replay is
+	// played from the raw action data instead, and stops only once it reaches that action.
+	void decode_actions() {
+		try {
+			ui.decode_actions();
+		} catch (const std::exception& e) {
+			log("not decoding actions: %s\n", e.what());
+		}
+	}
+
 	std::chrono::high_resolution_clock clock;
 	std::chrono::high_resolution_clock::time_point last_tick;
 
@@ -585,6 +595,7 @@ bool any_replay_loaded = false;
 extern "C" void load_replay(const uint8_t* data, size_t len) {
 	m->reset();
 	m->ui.load_replay_data(data, len);
+	m->decode_actions();
 	m->ui.set_image_data();
 	any_replay_loaded = true;
 }
@@ -621,6 +632,7 @@ int main(int argc, char const* argv[])
 
 #ifndef EMSCRIPTEN
 	ui.load_replay_file(argc > 1 ? argv[1] : "maps/p49.rep");
+	m.decode_actions();
 #endif
 
 	int2 map_size(ui.game_st.map_width, ui.game_st.map_height);